@@ -1,10 +1,17 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
 #include "public.sdk/source/vst/vstaudioprocessoralgo.h"
 
 #include "pluginterfaces/vst/ivstevents.h"
+#include "pluginterfaces/vst/ivstmessage.h"
 #include "pluginterfaces/vst/ivstmidicontrollers.h"
 #include "pluginterfaces/vst/ivstparameterchanges.h"
 #include "pluginterfaces/vst/ivstprocesscontext.h"
 #include "pluginterfaces/base/ibstream.h"
+#include "pluginterfaces/base/smartpointer.h"
 #include "base/source/fstreamer.h"
 
 #include "Spread.h"
@@ -21,12 +28,9 @@ Spread::Spread(void)
 Spread::~Spread(void)
 {
 	LOG("Spread destructor called.\n");
-	if (note_pool)
-	{
-		free(note_pool);
-		note_pool = nullptr;
-		pool_size = 0;
-	}
+	free(out_buffer.events);
+	free(timeline);
+	free(timeline_events);
 	LOG("Spread destructor exited.\n");
 }
 
@@ -37,13 +41,23 @@ tresult PLUGIN_API Spread::initialize(FUnknown* context)
 
 	if (result != kResultOk)
 	{
-		LOG("Spread::initialize failed with code %d.\n", result);
+		LOG_ERROR("Spread::initialize failed with code %d.\n", result);
 		return result;
 	}
 
 	addEventInput(STR16("Event In"));
 	addEventOutput(STR16("Event Out"));
-	counter = 0;
+
+	// The bus count can't change without the host rebuilding its routing, so all possible output buses are declared
+	// up front, inactive until the host connects them; the OutBuses parameter decides how many of them receive notes.
+	TChar busName[16] = STR16("Event Out ");
+	for (int32 b = 2; b <= max_out_buses; ++b)
+	{
+		busName[10] = (TChar)(u'0' + b);
+		busName[11] = 0;
+		addEventOutput(busName, 16, kAux, 0);
+	}
+	engine.reset();
 
 	LOG("Spread::initialize exited normally.\n");
 	return kResultOk;
@@ -61,12 +75,60 @@ tresult PLUGIN_API Spread::setActive(TBool state)
 {
 	LOG("Spread::setActive called.\n");
 	tresult result = AudioEffect::setActive(state);
+	active = state != 0;
 	if (state)
-		counter = 0;
+	{
+		apply_loaded_state();	// a state set since the last block, so that its capacity is allocated below
+
+		// Size everything process() needs now, so that it never calls the allocator.
+		if (!engine.allocate_pool() || !allocate_out_buffer() || !allocate_timeline())
+			result = kOutOfMemory;
+		engine.reset();
+
+		const std::string trace_path = trace_capture_path();
+		if (!trace_path.empty() && trace.open(trace_path.c_str()))
+			trace_pending.store(kTracePendingSnapshot | kTracePendingActivated);
+	}
+	else
+	{
+		trace.close();
+		engine.compact_pool();
+		free(out_buffer.events);
+		out_buffer.events = nullptr;
+		out_buffer.capacity = out_buffer.count = 0;
+		free(timeline);
+		free(timeline_events);
+		timeline = nullptr;
+		timeline_events = nullptr;
+	}
 	LOG("Spread::setActive exited with code %d.\n", result);
 	return result;
 }
 
+bool Spread::allocate_out_buffer(void)
+{
+	const uint32 needed = engine.max_output_events();
+	if (out_buffer.capacity != needed)
+	{
+		spread_event* const events = (spread_event*)realloc(out_buffer.events, needed * sizeof(*events));
+		if (!events)
+			return false;
+		out_buffer.events = events;
+		out_buffer.capacity = needed;
+	}
+	out_buffer.count = 0;
+	return true;
+}
+
+bool Spread::allocate_timeline(void)
+{
+	if (!timeline)
+		timeline = (timeline_entry*)malloc(timeline_capacity * sizeof(*timeline));
+	if (!timeline_events)
+		timeline_events = (Event*)malloc(timeline_capacity * sizeof(*timeline_events));
+	return timeline && timeline_events;
+}
+
 tresult PLUGIN_API Spread::setIoMode(IoMode mode)
 {
 	LOG("Spread::setIoMode called and exited.\n");
@@ -77,8 +139,8 @@ tresult PLUGIN_API Spread::setProcessing(TBool state)
 {
 	if (state)
 	{
-		counter = 0;
-		srand(0);
+		engine.reset();
+		trace_pending.fetch_or(kTracePendingSnapshot);
 	}
 	initial_points_sent = false;
 	LOG("Spread::setProcessing called and exited.\n");
@@ -92,6 +154,31 @@ tresult PLUGIN_API Spread::setState(IBStream* s)
 	IBStreamer streamer(s, kLittleEndian);
 	unsigned char loaded_oc;
 	int32 loaded_strat;
+	int32 loaded_evict = kEvictOldest;
+	uint32 loaded_capacity = default_note_capacity;
+	int32 loaded_model = kLoadCount;
+	int32 loaded_gain = 0;
+	int32 loaded_overload = default_overload_percent;
+	int32 loaded_release = 0;
+	unsigned char loaded_ob = 1;
+	uint64 loaded_seed = 0;
+	uint64 loaded_random = 0;
+	bool random_saved = false;	// if not, the random sequence starts afresh from the seed
+	unsigned char loaded_mpe_lower = 0;
+	unsigned char loaded_mpe_upper = 0;
+	zone_range loaded_zones[max_out_channels];
+	unsigned char loaded_spill = 0;
+	unsigned char loaded_share = 0;
+	unsigned char loaded_caps[max_out_channels] = {};
+	unsigned char loaded_overflow = kOverflowSteal;
+	unsigned char loaded_weights[max_out_channels];
+	for (int16_t c = 0; c < max_out_channels; ++c)
+	{
+		loaded_zones[c] = default_zone;
+		loaded_weights[c] = 1;
+	}
+	unsigned char loaded_costs[num_cost_ranges][num_cost_bands];
+	memcpy(loaded_costs, default_cost_table, sizeof(loaded_costs));
 
 	if (!streamer.readUChar8(loaded_oc))
 	{
@@ -100,27 +187,217 @@ tresult PLUGIN_API Spread::setState(IBStream* s)
 	}
 	else if (!streamer.readInt32(loaded_strat))
 		loaded_strat = kMinLoad;
-
-	if ((loaded_oc > 16) || (loaded_strat < 0) || (loaded_strat >= kNumStrategies))
+	else if (!streamer.readInt32(loaded_evict))
+		loaded_evict = kEvictOldest;
+	else if (!streamer.readInt32u(loaded_capacity))
+		loaded_capacity = default_note_capacity;
+	else if (!streamer.readInt32(loaded_model))
+		loaded_model = kLoadCount;
+	else if (streamer.readRaw(loaded_costs, sizeof(loaded_costs)) != sizeof(loaded_costs))
+		memcpy(loaded_costs, default_cost_table, sizeof(loaded_costs));
+	else if (!streamer.readInt32(loaded_gain))
+		loaded_gain = 0;
+	else if (!streamer.readInt32(loaded_overload))
+		loaded_overload = default_overload_percent;
+	else if (!streamer.readInt32(loaded_release))
+		loaded_release = 0;
+	else if (!streamer.readUChar8(loaded_ob))
+		loaded_ob = 1;
+	else if (!streamer.readInt64u(loaded_seed))
+		loaded_seed = 0;
+	else if (!(random_saved = streamer.readInt64u(loaded_random)))
+		loaded_random = 0;
+	else if (!streamer.readUChar8(loaded_mpe_lower))
+		loaded_mpe_lower = 0;
+	else if (!streamer.readUChar8(loaded_mpe_upper))
+		loaded_mpe_upper = 0;
+	else if (streamer.readRaw(loaded_zones, sizeof(loaded_zones)) != sizeof(loaded_zones))
+	{
+		for (int16_t c = 0; c < max_out_channels; ++c)
+			loaded_zones[c] = default_zone;
+	}
+	else if (!streamer.readUChar8(loaded_spill))
+		loaded_spill = 0;
+	else if (!streamer.readUChar8(loaded_share))
+		loaded_share = 0;
+	else if (streamer.readRaw(loaded_caps, sizeof(loaded_caps)) != sizeof(loaded_caps))
+		memset(loaded_caps, 0, sizeof(loaded_caps));
+	else if (!streamer.readUChar8(loaded_overflow))
+		loaded_overflow = kOverflowSteal;
+	else if (streamer.readRaw(loaded_weights, sizeof(loaded_weights)) != sizeof(loaded_weights))
+		memset(loaded_weights, 1, sizeof(loaded_weights));
+
+	if ((loaded_oc > max_out_channels) || (loaded_strat < 0) || (loaded_strat >= kNumStrategies)
+		|| (loaded_evict < 0) || (loaded_evict >= kNumEvictions)
+		|| (loaded_capacity != capacity_of_step(step_of_capacity(loaded_capacity)))
+		|| (loaded_model < 0) || (loaded_model >= kNumLoadModels)
+		|| (loaded_gain < 0) || (loaded_gain > max_feedback_gain)
+		|| (loaded_overload < min_overload_percent) || (loaded_overload > 100) || (loaded_overload % overload_percent_step)
+		|| (loaded_release < 0) || (loaded_release > max_release_ms)
+		|| (loaded_ob < 1) || (loaded_ob > max_out_buses)
+		|| (loaded_mpe_lower > max_mpe_members) || (loaded_mpe_upper > max_mpe_members)
+		|| (loaded_spill > max_zone_spill) || (loaded_overflow >= kNumOverflows))
 		return kResultFalse;
+	for (int16_t c = 0; c < max_out_channels; ++c)
+	{
+		const zone_range& z = loaded_zones[c];
+		if ((z.low_key > 127) || (z.high_key > 127) || (z.low_velocity > 127) || (z.high_velocity > 127)
+			|| (loaded_caps[c] > max_polyphony_cap) || (loaded_weights[c] < 1) || (loaded_weights[c] > max_channel_weight))
+			return kResultFalse;
+	}
+	for (int32 r = 0; r < num_cost_ranges; ++r)
+	{
+		for (int32 b = 0; b < num_cost_bands; ++b)
+		{
+			if ((loaded_costs[r][b] < 1) || (loaded_costs[r][b] > max_note_cost))
+				return kResultFalse;
+		}
+	}
 
-	out_channels = loaded_oc;
-	strategy = loaded_strat;
-	counter = 0;
-	srand(0);
+	// The audio thread may be routing with the engine, so the settings are only handed over here; process() applies
+	// them before its next block.  Wait out an earlier state that is being applied right now.
+	for (;;)
+	{
+		uint32 expected = state_handoff.load();
+		if ((expected != kStateApplying) && state_handoff.compare_exchange_weak(expected, kStateWriting))
+			break;
+		std::this_thread::yield();
+	}
+	loaded_state& ls = pending_state;
+	ls.out_channels = loaded_oc;
+	ls.out_buses = loaded_ob;
+	ls.strategy = loaded_strat;
+	ls.eviction = loaded_evict;
+	ls.capacity = loaded_capacity;
+	ls.load_model = loaded_model;
+	memcpy(ls.costs, loaded_costs, sizeof(ls.costs));
+	ls.feedback_gain = loaded_gain;
+	ls.overload_percent = loaded_overload;
+	ls.release_ms = loaded_release;
+	ls.seed = loaded_seed;
+	ls.random_state = loaded_random;
+	ls.random_saved = random_saved;
+	ls.mpe_lower = loaded_mpe_lower;
+	ls.mpe_upper = loaded_mpe_upper;
+	memcpy(ls.zones, loaded_zones, sizeof(ls.zones));
+	ls.zone_spill = loaded_spill;
+	ls.share_load = loaded_share != 0;
+	memcpy(ls.caps, loaded_caps, sizeof(ls.caps));
+	ls.overflow = loaded_overflow;
+	memcpy(ls.weights, loaded_weights, sizeof(ls.weights));
+	state_handoff.store(kStateReady);
+	if (!active)
+		apply_loaded_state();	// process() isn't running, so there is no block to wait for
 
 	LOG("Spread::setState exited successfully.\n");
 	return kResultOk;
 }
 
+// Applies the settings setState handed over, if there are any.  Called by the audio thread at the start of a block,
+// or by the host's thread while the plug-in is inactive.
+bool Spread::apply_loaded_state(void)
+{
+	uint32 expected = kStateReady;
+	if (!state_handoff.compare_exchange_strong(expected, kStateApplying))
+		return false;
+
+	const loaded_state& ls = pending_state;
+	engine.set_outchannels(nullptr, ls.out_channels, 0);
+	engine.set_outbuses(nullptr, ls.out_buses, 0);
+	engine.set_strategy(ls.strategy);
+	engine.set_eviction(ls.eviction);
+	engine.set_capacity(ls.capacity);	// applied when the plug-in is next activated
+	engine.set_load_model(ls.load_model);
+	engine.set_feedback_gain(ls.feedback_gain);
+	engine.set_overload_percent(ls.overload_percent);
+	engine.set_release_ms(ls.release_ms);
+	engine.set_mpe_zones(ls.mpe_lower, ls.mpe_upper);
+	for (int16_t c = 0; c < max_out_channels; ++c)
+		engine.set_zone(c, ls.zones[c]);
+	engine.set_zone_spill(ls.zone_spill);
+	engine.set_share_load(ls.share_load);
+	for (int16_t c = 0; c < max_out_channels; ++c)
+	{
+		engine.set_polyphony_cap(c, ls.caps[c]);
+		engine.set_channel_weight(c, ls.weights[c]);
+	}
+	engine.set_overflow(ls.overflow);
+	for (int32 r = 0; r < num_cost_ranges; ++r)
+	{
+		for (int32 b = 0; b < num_cost_bands; ++b)
+			engine.set_cost(r, b, ls.costs[r][b]);
+	}
+	engine.set_seed(ls.seed);
+	engine.reset();
+	if (ls.random_saved)
+		engine.set_random_state(ls.random_state);	// resume the random sequence where it was saved
+	state_handoff.store(kStateIdle);
+	trace_pending.fetch_or(kTracePendingSnapshot);
+	return true;
+}
+
 tresult PLUGIN_API Spread::getState(IBStream* s)
 {
 	LOG("Spread::getState called.\n");
 
+	// A state setState handed over that the audio thread hasn't applied yet is what the host last set, so save that.
+	loaded_state ls;
+	if (state_handoff.load() == kStateReady)
+	{
+		ls = pending_state;
+		if (!ls.random_saved)
+		{
+			// where reset will start the sequence
+			pcg32 rng;
+			rng.seed(ls.seed);
+			ls.random_state = rng.get_state();
+		}
+	}
+	else
+	{
+		ls.out_channels = engine.get_outchannels();
+		ls.out_buses = engine.get_outbuses();
+		ls.strategy = engine.get_strategy();
+		ls.eviction = engine.get_eviction();
+		ls.capacity = engine.get_capacity();
+		ls.load_model = engine.get_load_model();
+		for (int32 r = 0; r < num_cost_ranges; ++r)
+		{
+			for (int32 b = 0; b < num_cost_bands; ++b)
+				ls.costs[r][b] = engine.get_cost(r, b);
+		}
+		ls.feedback_gain = engine.get_feedback_gain();
+		ls.overload_percent = engine.get_overload_percent();
+		ls.release_ms = engine.get_release_ms();
+		ls.seed = engine.get_seed();
+		ls.random_state = engine.get_random_state();
+		ls.mpe_lower = engine.get_mpe_lower();
+		ls.mpe_upper = engine.get_mpe_upper();
+		for (int16_t c = 0; c < max_out_channels; ++c)
+		{
+			ls.zones[c] = engine.get_zone(c);
+			ls.caps[c] = engine.get_polyphony_cap(c);
+			ls.weights[c] = engine.get_channel_weight(c);
+		}
+		ls.zone_spill = engine.get_zone_spill();
+		ls.share_load = engine.is_sharing_load();
+		ls.overflow = engine.get_overflow();
+	}
+
 	IBStreamer streamer(s, kLittleEndian);
-	if (!streamer.writeUChar8(out_channels) || !streamer.writeInt32(strategy))
+	if (!streamer.writeUChar8((unsigned char)ls.out_channels) || !streamer.writeInt32(ls.strategy)
+		|| !streamer.writeInt32(ls.eviction) || !streamer.writeInt32u(ls.capacity)
+		|| !streamer.writeInt32(ls.load_model) || (streamer.writeRaw(ls.costs, sizeof(ls.costs)) != sizeof(ls.costs))
+		|| !streamer.writeInt32(ls.feedback_gain) || !streamer.writeInt32(ls.overload_percent)
+		|| !streamer.writeInt32(ls.release_ms) || !streamer.writeUChar8((unsigned char)ls.out_buses)
+		|| !streamer.writeInt64u(ls.seed) || !streamer.writeInt64u(ls.random_state)
+		|| !streamer.writeUChar8((unsigned char)ls.mpe_lower) || !streamer.writeUChar8((unsigned char)ls.mpe_upper)
+		|| (streamer.writeRaw(ls.zones, sizeof(ls.zones)) != sizeof(ls.zones)) || !streamer.writeUChar8((unsigned char)ls.zone_spill)
+		|| !streamer.writeUChar8(ls.share_load ? 1 : 0) || (streamer.writeRaw(ls.caps, sizeof(ls.caps)) != sizeof(ls.caps))
+		|| !streamer.writeUChar8((unsigned char)ls.overflow)
+		|| (streamer.writeRaw(ls.weights, sizeof(ls.weights)) != sizeof(ls.weights)))
 	{
-		LOG("Spread::getState failed due to streamer error.\n");
+		LOG_ERROR("Spread::getState failed due to streamer error.\n");
 		return kResultFalse;
 	}
 
@@ -133,6 +410,7 @@ tresult PLUGIN_API Spread::setupProcessing(ProcessSetup& newSetup)
 	LOG("Spread::setupProcessing called.\n");
 	processContextRequirements.flags = kNeedProjectTimeMusic | kNeedTempo;
 	tresult result = AudioEffect::setupProcessing(newSetup);
+	engine.set_sample_rate(newSetup.sampleRate);
 	LOG("Spread::setupProcessing exited with code %d.\n", result);
 	return result;
 }
@@ -154,7 +432,7 @@ tresult PLUGIN_API Spread::getRoutingInfo(RoutingInfo& inInfo, RoutingInfo& outI
 	}
 	else
 	{
-		LOG("Spread::getRoutingInfo exited with failure.\n");
+		LOG_ERROR("Spread::getRoutingInfo exited with failure.\n");
 		return kResultFalse;
 	}
 }
@@ -164,400 +442,160 @@ static inline ParamValue normalize(int32 value, int32 max_value)
 	return (value <= 0) ? 0.0 : (value >= max_value) ? 1.0 : (((ParamValue)value + 0.5) / (ParamValue)(max_value + 1));
 }
 
-static inline int32 discretize(ParamValue value, int32 max_value)
-{
-	const int32 discrete = (int32)(value * (ParamValue)(max_value + 1));
-	return (discrete <= 0) ? 0 : (discrete >= max_value) ? max_value : discrete;
-}
-
-inline note_pool_index Spread::get_next(pitch_or_index poi)
-{
-	return PoI_IS_PITCH(poi) ? (held_notes[PITCH_OF_PoI(poi)] - 1) : (poi + 1 + note_pool[poi].next);
-}
-
-inline void Spread::set_next(pitch_or_index poi, note_pool_index j)
-{
-	if (PoI_IS_PITCH(poi))
-		held_notes[PITCH_OF_PoI(poi)] = j + 1;
-	else
-		note_pool[poi].next = j - (poi + 1);
-}
-
-int16 Spread::delete_next(int32 pitch, pitch_or_index poi, int32* noteId)
+void Spread::flush_events(IEventList* events_out, const Event* sources)
 {
-	note_pool_index j = get_next(poi);
-	if ((j < 0) || (j >= pool_size))
-		return -1;
-
-	int16 out_channel = note_pool[j].io_channels & 0xF;
-	if (cstate[out_channel].load > 0)
-		--cstate[out_channel].load;
-	if ((sustain_pedal_down || (soslocked[pitch / 64] & (1ULL << pitch))) && (out_channel < out_channels))
-		++cstate[out_channel].susload;
-
-	if (noteId)
-		*noteId = note_pool[j].noteId;
-
-	set_next(poi, get_next(j));
-	set_next(j, free_list);
-	free_list = j;
-		
-	return out_channel;
-}
-
-int16 Spread::outchannel_of_note(bool delete_it, int16 pitch, int32 noteId, int16 in_channel)
-{
-	pitch_or_index prev = PITCH_TO_PoI(pitch);
-	for (note_pool_index i = get_next(prev); (0 <= i) && (i < pool_size); i = get_next((prev = i)))
+	if (trace.is_open())
 	{
-		if ((note_pool[i].noteId == noteId) && ((note_pool[i].io_channels >> 4) == in_channel))
-			return delete_it ? delete_next(pitch, prev, nullptr) : (note_pool[i].io_channels & 0xF);
+		trace_output_digest = trace_digest(trace_output_digest, out_buffer.events, out_buffer.count);
+		trace_outputs += out_buffer.count;
 	}
-
-	return -1;
-}
-
-tresult Spread::emergency_evict(IEventList* events_out, const Event& note_on_event)
-{
 	if (events_out)
 	{
-		int16 held_pitch = -1;
-		for (int16 pitch = 0; pitch < 128; ++pitch)
-		{
-			const note_pool_index i = get_next(PITCH_TO_PoI(pitch));
-			if (i >= 0)
-			{
-				if (get_next(i) >= 0)
-				{
-					held_pitch = pitch;
-					break;
-				}
-				else if (held_pitch < 0)
-					held_pitch = pitch;
-			}
-		}
-		if (held_pitch < 0)
-			return kResultFalse;
-
-		const int32 id = note_pool[get_next(PITCH_TO_PoI(held_pitch))].noteId;
-		const int16 out_channel = delete_next(held_pitch, PITCH_TO_PoI(held_pitch), nullptr);
-		if (out_channel < 0)
-			return kResultFalse;
-		else
+		for (uint32 i = 0; i < out_buffer.count; ++i)
 		{
+			const spread_event& e = out_buffer.events[i];
 			Event evt = {};
-			evt.sampleOffset = note_on_event.sampleOffset;
-			evt.ppqPosition = note_on_event.ppqPosition;
-			evt.type = Event::kNoteOffEvent;
-			evt.noteOff.channel = out_channel;
-			evt.noteOff.noteId = id;
-			evt.noteOff.pitch = held_pitch;
-			evt.noteOff.velocity = 1.F;
-			events_out->addEvent(evt);
-		}
-
-		return kResultOk;
-	}
-	else
-		return kResultFalse;
-}
-
-tresult Spread::add_note(const Event& note_on_event, int16 out_channel, IEventList* events_out)
-{
-	if (free_list >= pool_size)
-	{
-		if (pool_size >= max_held_notes)
-		{
-			if (emergency_evict(events_out, note_on_event) != kResultOk)
-				return kResultFalse;
-		}
-		else
-		{
-			free_list = pool_size;
-			pool_size = (pool_size <= 0) ? initial_note_pool_size : (pool_size * 2);
-			if (pool_size > max_held_notes)
-				pool_size = max_held_notes;
-			note_in_record* const new_pool = (note_in_record*)realloc(note_pool, pool_size * sizeof(*note_pool));
-			if (new_pool)
-			{
-				note_pool = new_pool;
-				memset(note_pool + free_list, 0, ((size_t)pool_size - (size_t)free_list) * sizeof(*note_pool));
-			}
+			if ((e.tag >= 0) && sources)
+				evt = sources[e.tag];
 			else
 			{
-				pool_size = free_list;
-				if (emergency_evict(events_out, note_on_event) != kResultOk)
-					return kResultFalse;
-			}
-		}
-	}
-
-	const note_pool_index slot = free_list;
-	if (slot >= pool_size)
-		return kResultFalse;
-	free_list = get_next(free_list);
-	note_pool[slot].noteId = note_on_event.noteOn.noteId;
-	note_pool[slot].io_channels = (note_on_event.noteOn.channel << 4) | out_channel;
-	set_next(slot, -1);
-
-	for (pitch_or_index poi = PITCH_TO_PoI(note_on_event.noteOn.pitch), next = get_next(poi); ; next = get_next((poi = next)))
-	{
-		if (next < 0)
-		{
-			set_next(poi, slot);
-			break;
-		}
-	}
-
-	++cstate[out_channel].load;
-
-	return kResultOk;
-}
-
-void Spread::set_outchannels(IEventList* events_out, int16 new_oc, int32 offset)
-{
-	if (sustain_pedal_down)
-	{
-		// clear sustain-load counters for channels dropped from the output spread
-		for (int16 c = new_oc; c < out_channels; ++c)
-			cstate[c].susload = 0;
-
-		if (events_out)
-		{
-			Event e = {};
-			e.type = Event::EventTypes::kLegacyMIDICCOutEvent;
-			e.sampleOffset = offset;
-			e.midiCCOut.controlNumber = kCtrlSustainOnOff;
-
-			// send pedal-off to channels dropped from the output spread
-			for (int16 c = new_oc; c < out_channels; ++c)
-			{
-				e.midiCCOut.channel = c;
-				events_out->addEvent(e);
-			}
-
-			// send pedal-on to channels added to the output spread
-			e.midiCCOut.value = 127;
-			for (int16 c = out_channels; c < new_oc; ++c)
-			{
-				e.midiCCOut.channel = c;
-				events_out->addEvent(e);
+				evt.sampleOffset = e.sampleOffset;
+				evt.ppqPosition = e.ppqPosition;
 			}
-		}
-	}
-	out_channels = new_oc;
-}
-
-void Spread::broadcast_event(IEventList* events_out, uint8 cc, uint8 value, int32 offset)
-{
-	if (events_out)
-	{
-		Event e = {};
-		e.type = Event::EventTypes::kLegacyMIDICCOutEvent;
-		e.sampleOffset = offset;
-		e.midiCCOut.controlNumber = cc;
-		e.midiCCOut.value = value;
-		for (int16 c = 0; c < out_channels; ++c)
-		{
-			e.midiCCOut.channel = c;
-			events_out->addEvent(e);
-		}
-	}
-}
-
-void Spread::press_sustain_pedal(IEventList* events_out, int32 offset)
-{
-	if (!sustain_pedal_down)
-	{
-		sustain_pedal_down = true;
-		broadcast_event(events_out, kCtrlSustainOnOff, 127, offset);
-	}
-}
-
-void Spread::release_sustain_pedal(IEventList* events_out, int32 offset)
-{
-	if (sustain_pedal_down)
-	{
-		sustain_pedal_down = false;
-		for (int16 c = 0; c < out_channels; ++c)
-			cstate[c].susload = 0;
-		broadcast_event(events_out, kCtrlSustainOnOff, 0, offset);
-	}
-}
-
-void Spread::press_sostenuto_pedal(IEventList* events_out, int32 offset)
-{
-	if (!sostenuto_pedal_down)
-	{
-		sostenuto_pedal_down = true;
-		broadcast_event(events_out, kCtrlSustenutoOnOff, 127, offset);
-	}
-
-	for (int32 pitch = 0; pitch < 128; ++pitch)
-	{
-		if (held_notes[pitch])
-			soslocked[pitch / 64] |= 1ULL << (pitch % 64);
-	}
-}
-
-void Spread::release_sostenuto_pedal(IEventList* events_out, int32 offset)
-{
-	if (sostenuto_pedal_down)
-	{
-		sostenuto_pedal_down = false;
-		broadcast_event(events_out, kCtrlSustenutoOnOff, 0, offset);
-	}
 
-	soslocked[0] = soslocked[1] = 0;
-}
-
-tresult Spread::note_on(IEventList* events_out, Event& evt)
-{
-	const int16 in_channel = evt.noteOn.channel;
-	const int16 pitch = evt.noteOn.pitch;
-	if ((0 <= in_channel) && (in_channel < 16) && (0 <= pitch) && (pitch < 128))
-	{
-		int16 out_channel = in_channel;
-		if (!bypass && (out_channels > 0))
-		{
-			switch (strategy)
+			switch (e.type)
 			{
-				case kMinLoad:
-				{
-					uint32 lowest_load = UINT32_MAX;
-					uint32 tally = 0;
-					++counter;
-					for (int16 i = 0; i < out_channels; ++i)
-					{
-						uint32 this_load = cstate[i].load + cstate[i].susload;
-						if (this_load < lowest_load)
-						{
-							out_channel = i;
-							lowest_load = this_load;
-							tally = 1;
-						}
-						else if (this_load == lowest_load)
-						{
-							if (counter % ++tally == 0)
-								out_channel = i;
-						}
-					}
-				}
+			case kSpreadNoteOn:
+				evt.type = Event::kNoteOnEvent;
+				evt.busIndex = e.bus;
+				evt.noteOn.channel = e.channel;
+				evt.noteOn.pitch = e.pitch;
+				evt.noteOn.noteId = e.noteId;
+				evt.noteOn.velocity = e.velocity;
 				break;
-
-				case kRoundRobin:
-				{
-					if (roundrobin_channel >= out_channels)
-						roundrobin_channel = 0;
-					out_channel = roundrobin_channel;
-					++roundrobin_channel;
-				}
+			case kSpreadNoteOff:
+				evt.type = Event::kNoteOffEvent;
+				evt.busIndex = e.bus;
+				evt.noteOff.channel = e.channel;
+				evt.noteOff.pitch = e.pitch;
+				evt.noteOff.noteId = e.noteId;
+				evt.noteOff.velocity = e.velocity;
 				break;
-
-				case kRandom:
-				{
-					const int max = RAND_MAX - RAND_MAX % out_channels;
-					int r;
-					do
-					{
-						r = rand();
-					} while (r >= max);
-					out_channel = r % out_channels;
-				}
+			case kSpreadPolyPressure:
+				evt.type = Event::kPolyPressureEvent;
+				evt.busIndex = e.bus;
+				evt.polyPressure.channel = e.channel;
+				evt.polyPressure.pitch = e.pitch;
+				evt.polyPressure.noteId = e.noteId;
+				evt.polyPressure.pressure = e.velocity;
+				break;
+			case kSpreadNoteExpression:
+				// forwarded unchanged, except to the output bus of the note it addresses
+				if (!sources)
+					continue;
+				evt.busIndex = e.bus;
+				break;
+			case kSpreadControlChange:
+				evt.type = Event::kLegacyMIDICCOutEvent;
+				evt.busIndex = e.bus;
+				evt.midiCCOut.channel = e.channel;
+				evt.midiCCOut.controlNumber = e.controlNumber;
+				evt.midiCCOut.value = e.value;
+				evt.midiCCOut.value2 = e.value2;
 				break;
+			default:
+				continue;
 			}
-		}
-
-		if (add_note(evt, out_channel, events_out) != kResultOk)
-			return kResultFalse;
-
-		evt.noteOn.channel = out_channel;
-		if (events_out)
 			events_out->addEvent(evt);
+		}
 	}
-	return kResultOk;
+	out_buffer.count = 0;
 }
 
-void Spread::note_off(IEventList* events_out, Event& evt)
+static bool to_spread_event(const Event& evt, int32 tag, spread_event& e)
 {
-	const int16 in_channel = evt.noteOff.channel;
-	const int16 pitch = evt.noteOff.pitch;
-	if ((0 <= in_channel) && (in_channel < 16) && (0 <= pitch) && (pitch < 128))
+	e = {};
+	e.sampleOffset = evt.sampleOffset;
+	e.ppqPosition = evt.ppqPosition;
+	e.tag = tag;
+	switch (evt.type)
 	{
-		const int16 out_channel = outchannel_of_note(true, pitch, evt.noteOff.noteId, in_channel);
-		if (out_channel >= 0)
-		{
-			evt.noteOff.channel = out_channel;
-			if (events_out)
-				events_out->addEvent(evt);
-		}
-		// Note-off without preceding note-on is ignored.
+	case Event::kNoteOnEvent:
+		e.type = kSpreadNoteOn;
+		e.channel = evt.noteOn.channel;
+		e.pitch = evt.noteOn.pitch;
+		e.noteId = evt.noteOn.noteId;
+		e.velocity = evt.noteOn.velocity;
+		return true;
+	case Event::kNoteOffEvent:
+		e.type = kSpreadNoteOff;
+		e.channel = evt.noteOff.channel;
+		e.pitch = evt.noteOff.pitch;
+		e.noteId = evt.noteOff.noteId;
+		e.velocity = evt.noteOff.velocity;
+		return true;
+	case Event::kPolyPressureEvent:
+		e.type = kSpreadPolyPressure;
+		e.channel = evt.polyPressure.channel;
+		e.pitch = evt.polyPressure.pitch;
+		e.noteId = evt.polyPressure.noteId;
+		e.velocity = evt.polyPressure.pressure;
+		return true;
+	case Event::kNoteExpressionValueEvent:
+		e.type = kSpreadNoteExpression;
+		e.noteId = evt.noteExpressionValue.noteId;
+		return true;
+	case Event::kNoteExpressionTextEvent:
+		e.type = kSpreadNoteExpression;
+		e.noteId = evt.noteExpressionText.noteId;
+		return true;
 	}
+	return false;
 }
 
-void Spread::polypressure(IEventList* events_out, Event& evt)
+static tresult set_parameter(IParameterChanges* params_out, IParamValueQueue*& queue, ParamID id, int32 offset, ParamValue value)
 {
-	int16 in_channel = evt.polyPressure.channel;
-	int16 pitch = evt.polyPressure.pitch;
-	if (events_out && (0 <= in_channel) && (in_channel < 16) && (0 <= pitch) && (pitch < 128))
+	if (params_out)
 	{
-		int16 out_channel = outchannel_of_note(false, pitch, evt.polyPressure.noteId, in_channel);
-		if (out_channel >= 0)
-		{
-			evt.polyPressure.channel = out_channel;
-			events_out->addEvent(evt);
-		}
-		// Poly-pressure without preceding note-on is ignored.
+		int32 dummy;
+		if (!queue)
+			queue = params_out->addParameterData(id, dummy);
+		if (queue)
+			return queue->addPoint(offset, value, dummy);
 	}
+	return kResultFalse;
 }
 
-void Spread::release_all(IEventList* events_out, int32 offset, TQuarterNotes pos, uint8 cc)
+// Advances a parameter cursor to its queue's next readable point; returns false once the queue is exhausted.
+template <typename cursor>
+static bool next_point(cursor& c)
 {
-	if (events_out)
+	while (++c.index < c.count)
 	{
-		Event evt = {};
-		evt.sampleOffset = offset;
-		evt.ppqPosition = pos;
-		evt.type = Event::kNoteOffEvent;
-		evt.noteOff.velocity = 1.;
-
-		for (int16 pitch = 0; pitch < 128; ++pitch)
+		if (c.queue->getPoint(c.index, c.sampleOffset, c.value) == kResultOk)
 		{
-			evt.noteOff.pitch = pitch;
-			for (;;)
-			{
-				evt.noteOff.channel = delete_next(pitch, PITCH_TO_PoI(pitch), &evt.noteOff.noteId);
-				if (evt.noteOff.channel >= 0)
-					events_out->addEvent(evt);
-				else
-					break;
-			}
+			if (c.value < 0.) c.value = 0.; else if (c.value > 1.) c.value = 1.;
+			return true;
 		}
-
-		evt.type = Event::kLegacyMIDICCOutEvent;
-		evt.midiCCOut.controlNumber = cc;
-		evt.midiCCOut.value = evt.midiCCOut.value2 = 0;
-		const int16 n = (out_channels <= 0) ? 16 : out_channels;
-		for (evt.midiCCOut.channel = 0; evt.midiCCOut.channel < n; ++evt.midiCCOut.channel)
-			events_out->addEvent(evt);
 	}
+	return false;
 }
 
-static tresult set_parameter(IParameterChanges* params_out, IParamValueQueue*& queue, ParamID id, int32 offset, ParamValue value)
+// Musical position of a sample offset within the block, for events generated by parameter changes
+static double ppq_at(const ProcessContext* context, int32 offset)
 {
-	if (params_out)
-	{
-		int32 dummy;
-		if (!queue)
-			queue = params_out->addParameterData(id, dummy);
-		if (queue)
-			return queue->addPoint(offset, value, dummy);
-	}
-	return kResultFalse;
+	if (!context || !(context->state & ProcessContext::kProjectTimeMusicValid))
+		return 0.;
+	double ppq = context->projectTimeMusic;
+	if ((context->state & ProcessContext::kTempoValid) && (context->sampleRate > 0.))
+		ppq += offset * context->tempo / (60. * context->sampleRate);
+	return ppq;
 }
 
 tresult PLUGIN_API Spread::process(ProcessData& data)
 {
+	const std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+
 	// We shouldn't be asked for audio output, but process it anyway (emit silence) to accommodate uncompliant hosts.
 	bool is32bit = (data.symbolicSampleSize == kSample32);
 	if (is32bit || (data.symbolicSampleSize == kSample64))
@@ -580,9 +618,16 @@ tresult PLUGIN_API Spread::process(ProcessData& data)
 	IEventList* events_in = data.inputEvents;
 	IEventList* events_out = data.outputEvents;
 
-	int32 numEvents = events_in ? events_in->getEventCount() : 0;
-	int32 numParamChanges[kNumParams] = {};
-	IParamValueQueue* paramQueue[kNumParams] = {};
+	// The pending point of each parameter queue that has changes this block, kept in parameter ID order
+	typedef struct {
+		IParamValueQueue* queue;
+		ParamID id;
+		int32 index, count;
+		int32 sampleOffset;
+		ParamValue value;
+	} param_cursor;
+	param_cursor cursors[kNumParams];
+	int32 numCursors = 0;
 	if (params_in)
 	{
 		int32 numParamsChanged = params_in->getParameterCount();
@@ -590,11 +635,17 @@ tresult PLUGIN_API Spread::process(ProcessData& data)
 		for (int32 i = 0; i < numParamsChanged; ++i)
 		{
 			IParamValueQueue* q = params_in->getParameterData(i);
-			ParamID id = q->getParameterId();
+			ParamID id = q ? q->getParameterId() : kNumParams;
 			if (id < kNumParams)
 			{
-				paramQueue[id] = q;
-				numParamChanges[id] = q->getPointCount();
+				param_cursor c = { q, id, -1, q->getPointCount(), 0, 0. };
+				if (next_point(c))
+				{
+					int32 j = numCursors++;
+					for (; (j > 0) && (cursors[j - 1].id > id); --j)
+						cursors[j] = cursors[j - 1];
+					cursors[j] = c;
+				}
 			}
 		}
 	}
@@ -613,145 +664,200 @@ tresult PLUGIN_API Spread::process(ProcessData& data)
 		}
 	}
 
-	int32 pindex[kNumParams] = {};
+	apply_loaded_state();
+	if (trace.is_open() && (trace.is_recording() || engine.is_idle()))
+	{
+		// a new trace waits for the notes kept from before it to finish sounding (see SpreadTrace.h)
+		const uint32 pending = trace_pending.exchange(0);
+		if (pending)
+		{
+			const trace_snapshot snapshot = take_trace_snapshot(engine, (pending & kTracePendingActivated) != 0);
+			trace.write(kTraceSnapshot, &snapshot, sizeof(snapshot));
+		}
+	}
+
+	// Merge the block's events and parameter points into the timeline, fetching each event from the host exactly once
+	// (the next one waits in pending until it wins a slot), and then route the timeline in one pass.  Events go before
+	// parameter points at the same offset, and points at the same offset go in parameter ID order.  A block too large
+	// for the timeline is handled in several passes; a pass never ends partway through a chord, whose notes are carried
+	// over to the start of the next pass instead.
+	const int32 numEvents = events_in ? events_in->getEventCount() : 0;
 	int32 eindex = 0;
+	Event pending;
+	bool has_pending = false;
+	uint32 carried = 0;
 	for (;;)
 	{
-		int32 nextSampleOffset = kMaxInt32;
-		int32 nextId = -1;
-
-		Event evt;
-		if (eindex < numEvents)
+		uint32 count = carried;
+		while (count < timeline_capacity)
 		{
-			if (events_in->getEvent(eindex, evt) == kResultOk)
+			timeline_entry& t = timeline[count];
+			while (!has_pending && (eindex < numEvents))
+				has_pending = (events_in->getEvent(eindex++, pending) == kResultOk);
+
+			int32 c = -1;
+			for (int32 i = 0; i < numCursors; ++i)
 			{
-				nextSampleOffset = evt.sampleOffset;
-				nextId = kNumParams + 1;
+				if ((c < 0) || (cursors[i].sampleOffset < cursors[c].sampleOffset))
+					c = i;
 			}
-		}
 
-		ParamValue value;
-		for (int32 i = 0; i < kNumParams; ++i)
-		{
-			if (pindex[i] < numParamChanges[i])
+			if (has_pending && ((c < 0) || (pending.sampleOffset <= cursors[c].sampleOffset)))
+			{
+				timeline_events[count] = pending;
+				t.sampleOffset = pending.sampleOffset;
+				t.id = timeline_event;
+				has_pending = false;
+			}
+			else if (c >= 0)
 			{
-				ParamValue v;
-				int32 o;
-				if (paramQueue[i]->getPoint(pindex[i], o, v) == kResultOk)
+				t.sampleOffset = cursors[c].sampleOffset;
+				t.id = (int32)cursors[c].id;
+				t.value = cursors[c].value;
+				if (!next_point(cursors[c]))
 				{
-					if (o < nextSampleOffset)
-					{
-						nextSampleOffset = o;
-						value = v;
-						nextId = i;
-					}
+					--numCursors;
+					for (int32 i = c; i < numCursors; ++i)
+						cursors[i] = cursors[i + 1];
 				}
 			}
+			else
+				break;	// no more note events or parameter changes
+			++count;
 		}
-		if (value < 0.) value = 0.; else if (value > 1.) value = 1.;
 
-		if (nextId < 0)
+		// If the pass is full and the next event continues a run of note-ons at one offset, hold back the run's last,
+		// unfinished chord for the next pass.
+		carried = 0;
+		while (!has_pending && (eindex < numEvents))
+			has_pending = (events_in->getEvent(eindex++, pending) == kResultOk);
+		if ((count == timeline_capacity) && has_pending && (pending.type == Event::kNoteOnEvent))
 		{
-			// no more note events or parameter changes
-			break;
+			uint32 run = 0;
+			while ((run < count) && (timeline[count - 1 - run].id == timeline_event)
+				&& (timeline[count - 1 - run].sampleOffset == pending.sampleOffset)
+				&& (timeline_events[count - 1 - run].type == Event::kNoteOnEvent))
+				++run;
+			carried = run % max_chord_notes;
+			count -= carried;
 		}
-		else if (nextId < kNumParams)
+		if (count == 0)
+			break;
+
+		for (uint32 i = 0; i < count; ++i)
 		{
-			switch (nextId)
+			const timeline_entry& t = timeline[i];
+			if (t.id != timeline_event)
 			{
-			case kOutChannels: // number of output channels changed
-				set_outchannels(events_out, discretize(value, 16), nextSampleOffset);
-				break;
-
-			case kStrategy: // note distribution strategy changed
-				strategy = discretize(value, kNumStrategies - 1);
-				break;
-
-			case kSustain: // sustain pedal changed
-				if (value > 0.)
-					press_sustain_pedal(events_out, nextSampleOffset);
-				else
-					release_sustain_pedal(events_out, nextSampleOffset);
-				break;
+				const double ppq = ppq_at(data.processContext, t.sampleOffset);
+				if (trace.is_open())
+				{
+					const trace_parameter p = { (uint32)t.id, t.sampleOffset, t.value, ppq };
+					trace.write(kTraceParameter, &p, sizeof(p));
+				}
+				if (engine.set_parameter(t.id, t.value, t.sampleOffset, ppq, &out_buffer))
+				{
+					// momentary trigger fired; switch it back off
+					const int32 o = (t.sampleOffset + 1 < data.numSamples) ? (t.sampleOffset + 1) : (data.numSamples - 1);
+					set_parameter(params_out, out_queue[t.id], t.id, o, 1.);
+				}
+				flush_events(events_out, nullptr);
+			}
+			else
+			{
+				// MIDI events, tagged with their timeline positions; note-ons sharing a sample offset go as a chord
+				spread_event chord[max_chord_notes];
+				uint32 n = 0;
+				while ((i + n < count) && (n < max_chord_notes) && (timeline[i + n].id == timeline_event)
+					&& (timeline[i + n].sampleOffset == t.sampleOffset) && (timeline_events[i + n].type == Event::kNoteOnEvent))
+				{
+					to_spread_event(timeline_events[i + n], (int32)(i + n), chord[n]);
+					++n;
+				}
 
-			case kSostenuto: // sostenuto pedal changed
-				if (value > 0.)
-					press_sostenuto_pedal(events_out, nextSampleOffset);
+				bool routed = true;
+				if (n > 1)
+				{
+					trace_events(chord, n);
+					routed = engine.chord_on(&out_buffer, chord, n);
+					i += n - 1;
+				}
 				else
-					release_sostenuto_pedal(events_out, nextSampleOffset);
-				break;
-
-			case kMuteAll: // release and un-sustain all notes
-				if (value < 0.5)
 				{
-					release_all(events_out, nextSampleOffset, evt.ppqPosition, kCtrlAllSoundsOff);
-					counter = 0;
-					srand(0);
-					for (int16 channel = 0; channel < 16; ++channel)
-						cstate[channel].susload = 0;
-					const int32 o = (nextSampleOffset + 1 < data.numSamples) ? (nextSampleOffset + 1) : (data.numSamples - 1);
-					set_parameter(params_out, out_queue[kMuteAll], kMuteAll, o, 1.);
+					spread_event e;
+					if (to_spread_event(timeline_events[i], (int32)i, e))
+					{
+						trace_events(&e, 1);
+						routed = engine.process_event(e, &out_buffer);
+					}
 				}
-				break;
-
-			case kReleaseAll: // release all notes without un-sustaining
-				if (value < 0.5)
+				flush_events(events_out, timeline_events);
+				if (!routed)
 				{
-					release_all(events_out, nextSampleOffset, evt.ppqPosition, kCtrlAllNotesOff);
-					counter = 0;
-					srand(0);
-					const int32 o = (nextSampleOffset + 1 < data.numSamples) ? (nextSampleOffset + 1) : (data.numSamples - 1);
-					set_parameter(params_out, out_queue[kReleaseAll], kReleaseAll, o, 1.);
+					finish_trace_block(0);
+					return kResultFalse;
 				}
-				break;
-
-			case kBypass: // bypass mode preserves channel without remapping
-				bypass = (value >= 0.5);
-				break;
 			}
-			++pindex[nextId];
 		}
-		else
+		for (uint32 i = 0; i < carried; ++i)
 		{
-			// MIDI event
-			switch (evt.type)
-			{
-			case Event::kNoteOnEvent:
-				if (note_on(events_out, evt) != kResultOk)
-					return kResultFalse;
-				break;
-			case Event::kNoteOffEvent:
-				note_off(events_out, evt);
-				break;
-			case Event::kPolyPressureEvent:
-				polypressure(events_out, evt);
-				break;
-			case Event::kNoteExpressionValueEvent:
-			case Event::kNoteExpressionTextEvent:
-				// Note expression events have no channel, so just re-broadcast them.
-				if (events_out)
-					events_out->addEvent(evt);
-				break;
-			}
-			++eindex;
+			timeline[i] = timeline[count + i];
+			timeline_events[i] = timeline_events[count + i];
 		}
 	}
 
+	engine.advance_clock(data.numSamples);
+	finish_trace_block(data.numSamples);
+	publish_telemetry(data.numSamples, (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started).count() / 1000.,
+		params_out, out_queue);
+
 	// Send initial parameter values to help hosts sync them with the VST
 	if (!initial_points_sent && params_out)
 	{
 		initial_points_sent = true;
-		const ParamValue default_values[kNumParams] = {
-			normalize(out_channels, 16),			// kOutChannels
-			normalize(strategy, kNumStrategies - 1),// kStrategy
-			sustain_pedal_down ? 1. : 0.,			// kSustainPedal
-			sostenuto_pedal_down ? 1. : 0.,			// kSostenutoPedal
+		ParamValue default_values[kNumParams] = {
+			normalize(engine.get_outchannels(), max_out_channels),	// kOutChannels
+			normalize(engine.get_strategy(), kNumStrategies - 1),	// kStrategy
+			engine.is_sustain_pedal_down() ? 1. : 0.,				// kSustainPedal
+			engine.is_sostenuto_pedal_down() ? 1. : 0.,				// kSostenutoPedal
 			1.,										// kMuteAll (0=on, 1=off as per MIDI standard)
 			1.,										// kReleaseAll (0=on, 1=off as per MIDI standard)
 			0.,										// kBypass
+			normalize(engine.get_eviction(), kNumEvictions - 1),	// kEviction
+			normalize(step_of_capacity(engine.get_capacity()), num_capacity_steps - 1),	// kCapacity
+			normalize(engine.get_load_model(), kNumLoadModels - 1),	// kLoadModel
 		};
+		default_values[kOutBuses] = normalize(engine.get_outbuses() - 1, max_out_buses - 1);
+		default_values[kMpeLowerMembers] = normalize(engine.get_mpe_lower(), max_mpe_members);
+		default_values[kMpeUpperMembers] = normalize(engine.get_mpe_upper(), max_mpe_members);
+		default_values[kZoneSpill] = normalize(engine.get_zone_spill(), max_zone_spill);
+		default_values[kShareLoad] = engine.is_sharing_load() ? 1. : 0.;
+		default_values[kOverflow] = normalize(engine.get_overflow(), kNumOverflows - 1);
+		for (int16_t c = 0; c < max_out_channels; ++c)
+		{
+			default_values[kPolyphonyCap + c] = normalize(engine.get_polyphony_cap(c), max_polyphony_cap);
+			default_values[kChannelWeight + c] = normalize(engine.get_channel_weight(c) - 1, max_channel_weight - 1);
+			const zone_range& z = engine.get_zone(c);
+			default_values[kZoneLowKey + c] = normalize(z.low_key, 127);
+			default_values[kZoneHighKey + c] = normalize(z.high_key, 127);
+			default_values[kZoneLowVelocity + c] = normalize(z.low_velocity, 127);
+			default_values[kZoneHighVelocity + c] = normalize(z.high_velocity, 127);
+		}
+		default_values[kReleaseTime] = (ParamValue)engine.get_release_ms() / (ParamValue)max_release_ms;
+		default_values[kFeedbackGain] = normalize(engine.get_feedback_gain(), max_feedback_gain);
+		default_values[kOverloadLevel] = normalize((engine.get_overload_percent() - min_overload_percent) / overload_percent_step, num_overload_steps - 1);
+		for (int16 t = 0; t < max_out_targets; ++t)
+			default_values[kMeasuredLoad + t] = engine.get_measured_load(t);
+		for (int32 r = 0; r < num_cost_ranges; ++r)
+		{
+			for (int32 b = 0; b < num_cost_bands; ++b)
+				default_values[kCostTable + r * num_cost_bands + b] = normalize(engine.get_cost(r, b) - 1, max_note_cost - 1);
+		}
 		for (ParamID i = 0; i < kNumParams; ++i)
 		{
+			if (((i >= kChannelMessage) && (i < kChannelMessage + kNumChannelMessages * 16)) || ((i >= kLoadImbalance) && (i <= kWorstProcessTime))
+				|| (i == kLogLevel))
+				continue;	// MIDI input, telemetry, and the controller's log level, not settings
 			if (!out_queue[i] || out_queue[i]->getPointCount() <= 0)
 			{
 				if (set_parameter(params_out, out_queue[i], i, 0, default_values[i]) != kResultTrue)
@@ -762,3 +868,110 @@ tresult PLUGIN_API Spread::process(ProcessData& data)
 
 	return kResultOk;
 }
+
+// Records input for the trace, if one is being captured: a single event, or a chord of up to max_chord_notes.
+void Spread::trace_events(const spread_event* events, uint32 count)
+{
+	if (!trace.is_open())
+		return;
+	if (count == 1)
+	{
+		const trace_event t = to_trace_event(events[0]);
+		trace.write(kTraceEvent, &t, sizeof(t));
+		return;
+	}
+	unsigned char record[sizeof(uint16) + max_chord_notes * sizeof(trace_event)];
+	const uint16 n = (uint16)count;
+	memcpy(record, &n, sizeof(n));
+	for (uint32 i = 0; i < count; ++i)
+	{
+		const trace_event t = to_trace_event(events[i]);
+		memcpy(record + sizeof(n) + i * sizeof(t), &t, sizeof(t));
+	}
+	trace.write(kTraceChord, record, (uint16)(sizeof(n) + count * sizeof(trace_event)));
+}
+
+void Spread::finish_trace_block(int32 samples)
+{
+	if (!trace.is_open())
+		return;
+	const trace_block b = { samples, trace_outputs, trace_output_digest };
+	trace.write(kTraceBlock, &b, sizeof(b));
+	trace_output_digest = trace_digest_basis;
+	trace_outputs = 0;
+}
+
+// Every telemetry period, snapshots the engine's state into the ring for the controller and updates the read-only
+// meter parameters.  Runs on the audio thread.
+void Spread::publish_telemetry(int32 samples, double process_us, IParameterChanges* params_out, IParamValueQueue** out_queue)
+{
+	if (process_us > worst_process_us)
+		worst_process_us = process_us;
+	telemetry_samples += samples;
+	const double seconds = (processSetup.sampleRate > 0.) ? ((double)telemetry_samples / processSetup.sampleRate) : 0.;
+	if (seconds < 1. / telemetry_rate)
+		return;
+
+	spread_telemetry& t = telemetry;
+	for (int16 i = 0; i < max_out_targets; ++i)
+	{
+		t.load[i] = engine.get_load(i);
+		t.susload[i] = engine.get_susload(i);
+		t.tail[i] = engine.get_tail(i);
+	}
+	t.held_notes = engine.get_held_count();
+	t.capacity = engine.get_capacity();
+	t.note_ons = engine.get_note_on_count();
+	t.evictions = engine.get_eviction_count();
+	t.active_targets = (engine.get_outchannels() > 0) ? (int16)(engine.get_outchannels() * engine.get_outbuses()) : 0;
+	t.imbalance = engine.get_imbalance();
+	t.notes_per_second = (float)((double)(t.note_ons - telemetry_note_ons) / seconds);
+	t.evictions_per_second = (float)((double)(t.evictions - telemetry_evictions) / seconds);
+	t.worst_process_us = (float)worst_process_us;
+	telemetry_ring.push(t);	// dropped if the controller isn't keeping up
+
+	if (params_out)
+	{
+		const ParamValue occupancy = (t.capacity > 0) ? ((ParamValue)t.held_notes / (ParamValue)t.capacity) : 0.;
+		set_parameter(params_out, out_queue[kLoadImbalance], kLoadImbalance, 0, t.imbalance);
+		set_parameter(params_out, out_queue[kNotesPerSecond], kNotesPerSecond, 0, (t.notes_per_second < max_meter_rate) ? (t.notes_per_second / max_meter_rate) : 1.);
+		set_parameter(params_out, out_queue[kEvictionsPerSecond], kEvictionsPerSecond, 0, (t.evictions_per_second < max_meter_rate) ? (t.evictions_per_second / max_meter_rate) : 1.);
+		set_parameter(params_out, out_queue[kPoolOccupancy], kPoolOccupancy, 0, (occupancy < 1.) ? occupancy : 1.);
+		set_parameter(params_out, out_queue[kWorstProcessTime], kWorstProcessTime, 0, (worst_process_us < max_meter_process_us) ? (worst_process_us / max_meter_process_us) : 1.);
+	}
+
+	telemetry_samples = 0;
+	telemetry_note_ons = t.note_ons;
+	telemetry_evictions = t.evictions;
+	worst_process_us = 0.;
+}
+
+// Runs on the message thread: the telemetry ring's consumer, and where the log level may change.
+tresult PLUGIN_API Spread::notify(IMessage* message)
+{
+	if (message && (strcmp(message->getMessageID(), log_level_message_id) == 0))
+	{
+		int64 level;
+		if (message->getAttributes()->getInt(log_level_attribute, level) == kResultOk)
+			spread_log_set_level((int32_t)level);
+		return kResultOk;
+	}
+	if (!message || strcmp(message->getMessageID(), telemetry_request_id) != 0)
+		return AudioEffect::notify(message);
+
+	spread_telemetry newest;
+	bool any = false;
+	while (telemetry_ring.pop(newest))
+		any = true;
+	if (any)
+	{
+		IPtr<IMessage> reply = owned(allocateMessage());
+		if (reply)
+		{
+			reply->setMessageID(telemetry_reply_id);
+			reply->getAttributes()->setBinary(telemetry_attribute, &newest, sizeof(newest));
+			sendMessage(reply);
+		}
+	}
+	return kResultOk;
+}
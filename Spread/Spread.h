@@ -1,6 +1,6 @@
 #pragma once
 
-#undef LOGGING
+#define LOGGING	// compiled in; nothing is written unless the runtime log level is raised
 
 #include "public.sdk/source/vst/vsteditcontroller.h"
 #include "public.sdk/source/vst/vstaudioeffect.h"
@@ -8,61 +8,112 @@
 #include "base/source/fstring.h"
 #include "pluginterfaces/base/funknown.h"
 
+#include "SpreadEngine.h"
+#include "SpreadTelemetry.h"
+#include "SpreadLog.h"
+#include "SpreadTrace.h"
+
 using namespace Steinberg;
 using namespace Steinberg::Vst;
 
-constexpr uint32 max_held_notes = 512;
-constexpr uint32 initial_note_pool_size = 64;
+constexpr const TChar* strategy_name[kNumStrategies] = {
+	STR16("Min-Load"),
+	STR16("Round Robin"),
+	STR16("Random"),
+	STR16("Two Choices"),
+	STR16("Zoned")
+};
 
-// Parameter enumeration
-enum SpreadParams : ParamID
-{
-	kOutChannels = 0,
-	kStrategy = 1,
-	kSustain = 2,
-	kSostenuto = 3,
-	kMuteAll = 4,
-	kReleaseAll = 5,
-	kBypass = 6,
-	kNumParams = 7
+constexpr const TChar* eviction_name[kNumEvictions] = {
+	STR16("Oldest"),
+	STR16("Quietest"),
+	STR16("Busiest Channel"),
+	STR16("Stacked First")
 };
 
-enum Strategy : int32
-{
-	kMinLoad = 0,
-	kRoundRobin = 1,
-	kRandom = 2,
-	kNumStrategies = 3
+constexpr const TChar* capacity_name[num_capacity_steps] = {
+	STR16("128"),
+	STR16("256"),
+	STR16("512"),
+	STR16("1024"),
+	STR16("2048"),
+	STR16("4096"),
+	STR16("8192"),
+	STR16("16384")
 };
 
-constexpr const TChar* strategy_name[kNumStrategies] = {
-	STR16("Min-Load"),
-	STR16("Round Robin"),
-	STR16("Random")
+constexpr const TChar* load_model_name[kNumLoadModels] = {
+	STR16("Note Count"),
+	STR16("Weighted")
 };
 
-// Plugin processor GUID - must be unique
-static const FUID SpreadProcessorUID(0x152C7B8D, 0x71604051, 0x8FD3A939, 0x17EB5368);
+constexpr const TChar* overflow_name[kNumOverflows] = {
+	STR16("Steal Oldest"),
+	STR16("Exceed Cap"),
+	STR16("Drop Note")
+};
 
-// -1 = none
-typedef int16 note_pool_index;
+constexpr const TChar* log_level_name[kLogTrace + 1] = {
+	STR16("Off"),
+	STR16("Errors"),
+	STR16("Info"),
+	STR16("Trace")
+};
 
-// non-negative = note_pool array index
-// negative = -pitch - 1
-typedef int16 pitch_or_index;
-#define PoI_IS_PITCH(poi) ((poi) < 0)
-#define PITCH_TO_PoI(pitch) (-(pitch) - 1)
-#define PITCH_OF_PoI(poi) (-(poi) - 1)
+// Cost table parameter titles, by pitch range then velocity band
+constexpr const TChar* cost_name[num_cost_ranges * num_cost_bands] = {
+	STR16("Cost Bass Soft"), STR16("Cost Bass Medium"), STR16("Cost Bass Loud"), STR16("Cost Bass Max"),
+	STR16("Cost Low Soft"), STR16("Cost Low Medium"), STR16("Cost Low Loud"), STR16("Cost Low Max"),
+	STR16("Cost Mid Soft"), STR16("Cost Mid Medium"), STR16("Cost Mid Loud"), STR16("Cost Mid Max"),
+	STR16("Cost High Soft"), STR16("Cost High Medium"), STR16("Cost High Loud"), STR16("Cost High Max")
+};
 
+// One parameter point or input event of a process block, in the order the engine is to see them
 typedef struct {
-	int32 noteId;
-	note_pool_index next; // relative offset from current index + 1
-	uint8 io_channels;
-} note_in_record;
+	int32 sampleOffset;
+	int32 id;			// parameter ID, or timeline_event for an input event (kept in timeline_events at the same position)
+	ParamValue value;	// clamped normalized value (parameter points only)
+} timeline_entry;
+
+constexpr int32 timeline_event = -1;
+constexpr uint32 timeline_capacity = 1024;	// entries gathered per pass; larger blocks are processed in several passes
+
+// What the next processed block must record before its input, while a trace is being captured
+enum TracePending : uint32
+{
+	kTracePendingSnapshot = 1,	// the settings or the distribution sequence changed outside process()
+	kTracePendingActivated = 2	// the note pool was allocated
+};
 
+// Settings read and checked by setState on the host's thread, for the audio thread to apply at the start of its next
+// block (or for setActive to apply while process() can't be running)
 typedef struct {
-	uint32 load, susload;
-} out_channel_state;
+	int16 out_channels, out_buses;
+	int32 strategy, eviction, load_model, overflow;
+	uint32 capacity;
+	uint8 costs[num_cost_ranges][num_cost_bands];
+	int32 feedback_gain, overload_percent, release_ms;
+	uint64 seed, random_state;
+	bool random_saved;	// if not, the random sequence starts afresh from the seed
+	int16 mpe_lower, mpe_upper;
+	zone_range zones[max_out_channels];
+	int32 zone_spill;
+	bool share_load;
+	uint8 caps[max_out_channels];
+	uint8 weights[max_out_channels];
+} loaded_state;
+
+// Who has loaded_state: setState fills it while kStateWriting, and the audio thread applies it while kStateApplying
+enum StateHandoff : uint32
+{
+	kStateIdle = 0,
+	kStateWriting = 1,
+	kStateReady = 2,	// filled and not yet applied
+	kStateApplying = 3
+};
+
+// Plugin processor GUID - must be unique
+static const FUID SpreadProcessorUID(0x152C7B8D, 0x71604051, 0x8FD3A939, 0x17EB5368);
 
 class Spread : public AudioEffect
 {
@@ -85,46 +136,37 @@ public:
 	tresult PLUGIN_API setState(IBStream* state);
 	tresult PLUGIN_API getState(IBStream* state);
 	tresult PLUGIN_API canProcessSampleSize(int32 symbolicSampleSize);
+	tresult PLUGIN_API notify(IMessage* message);
 	~Spread(void);
 
 protected:
-	inline note_pool_index get_next(pitch_or_index poi);
-	inline void set_next(pitch_or_index poi, note_pool_index j);
-	int16 delete_next(int32 pitch, pitch_or_index poi, int32* noteId); // returns out_channel of deleted note
-	tresult add_note(const Event& note_on_event, int16 out_channel, IEventList* events_out);
-	int16 outchannel_of_note(bool delete_it, int16 pitch, int32 noteId, int16 in_channel);
-	tresult emergency_evict(IEventList* events_out, const Event& note_on_event);
-
-	void set_outchannels(IEventList* events_out, int16 new_oc, int32 offset);
-	void broadcast_event(IEventList* events_out, uint8 cc, uint8 value, int32 offset);
-	void press_sustain_pedal(IEventList* events_out, int32 offset);
-	void release_sustain_pedal(IEventList* events_out, int32 offset);
-	void press_sostenuto_pedal(IEventList* events_out, int32 offset);
-	void release_sostenuto_pedal(IEventList* events_out, int32 offset);
-	tresult note_on(IEventList* events_out, Event& evt);
-	void note_off(IEventList* events_out, Event& evt);
-	void polypressure(IEventList* events_out, Event& evt);
-	void release_all(IEventList* events_out, int32 offset, TQuarterNotes pos, uint8 cc);
-
-	out_channel_state cstate[16] = {};
-	note_pool_index held_notes[128] = {};
-	note_in_record* note_pool = nullptr;
-	note_pool_index free_list = 0; // if free_list == pool_size then no free slots left in held_notes
-	note_pool_index pool_size = 0;
-	uint64 soslocked[2] = {};
-	uint32 counter = 0; // for generating a uniform distribution of values non-randomly
-	int32 strategy = kMinLoad;
-	int16 out_channels = 4;
-	int16 roundrobin_channel = 0;
-	bool sustain_pedal_down = false;
-	bool sostenuto_pedal_down = false;
-	bool bypass = false;
+	void flush_events(IEventList* events_out, const Event* sources);	// sources are indexed by output event tag
+	bool allocate_out_buffer(void);
+	bool allocate_timeline(void);
+	void publish_telemetry(int32 samples, double process_us, IParameterChanges* params_out, IParamValueQueue** out_queue);
+	void trace_events(const spread_event* events, uint32 count);
+	void finish_trace_block(int32 samples);
+	bool apply_loaded_state(void);
+
+	SpreadEngine engine;
+	spread_output out_buffer = { nullptr, 0, 0 };	// sized for the engine's note capacity in setActive
+	timeline_entry* timeline = nullptr;	// allocated in setActive, along with a copy of each gathered event
+	Event* timeline_events = nullptr;
 	bool initial_points_sent = false;
+	bool active = false;	// between setActive(true) and setActive(false), when only the audio thread may change the engine
+
+	loaded_state pending_state;	// handed from setState to the audio thread
+	std::atomic<uint32> state_handoff{ kStateIdle };	// StateHandoff
+
+	spsc_ring<spread_telemetry, telemetry_ring_size> telemetry_ring;	// audio thread to message thread
+	spread_telemetry telemetry = {};	// the snapshot being built (audio thread only)
+	int64 telemetry_samples = 0;		// samples processed since the last snapshot
+	uint32 telemetry_note_ons = 0;		// engine counts at the last snapshot
+	uint32 telemetry_evictions = 0;
+	double worst_process_us = 0.;
+
+	trace_writer trace;	// open while capturing, which SPREAD_TRACE_DIR turns on at activation
+	std::atomic<uint32> trace_pending{ 0 };	// TracePending flags
+	uint64 trace_output_digest = trace_digest_basis;	// of the current block's output so far
+	uint32 trace_outputs = 0;
 };
-
-#ifdef LOGGING
-	void log(const char* format, ...);
-#	define LOG(format, ...) log((format), __VA_ARGS__)
-#else
-#	define LOG(format, ...) 0
-#endif
@@ -1,4 +1,8 @@
+#include <cstring>
+
 #include "pluginterfaces/base/ibstream.h"
+#include "pluginterfaces/base/smartpointer.h"
+#include "pluginterfaces/vst/ivstmessage.h"
 #include "base/source/fstreamer.h"
 #include <pluginterfaces/vst/ivstmidicontrollers.h>
 
@@ -67,6 +71,15 @@ tresult PLUGIN_API SpreadController::initialize(FUnknown* context)
 	ocParam->getInfo().defaultNormalizedValue = normalize(4, 16);
 	parameters.addParameter(ocParam);
 
+	StringListParameter* obParam = new StringListParameter(STR16("OutBuses"), kOutBuses);
+	for (int32 i = 1; i <= max_out_buses; ++i)
+	{
+		uint32_to_str16(ocString, i);
+		obParam->appendString(ocString);
+	}
+	obParam->getInfo().defaultNormalizedValue = normalize(0, max_out_buses - 1);
+	parameters.addParameter(obParam);
+
 	StringListParameter* sParam = new StringListParameter(STR16("Strategy"), kStrategy);
 	for (int32 i = 0; i < kNumStrategies; ++i)
 		sParam->appendString(strategy_name[i]);
@@ -90,6 +103,133 @@ tresult PLUGIN_API SpreadController::initialize(FUnknown* context)
 
 	parameters.addParameter(STR16("Bypass"), nullptr, 1, 0., ParameterInfo::kIsBypass, kBypass);
 
+	StringListParameter* eParam = new StringListParameter(STR16("Eviction"), kEviction);
+	for (int32 i = 0; i < kNumEvictions; ++i)
+		eParam->appendString(eviction_name[i]);
+	eParam->getInfo().defaultNormalizedValue = normalize(kEvictOldest, kNumEvictions - 1);
+	parameters.addParameter(eParam);
+
+	// Changing the capacity reallocates the note pool, so it takes effect when the plug-in is next activated.
+	StringListParameter* capParam = new StringListParameter(STR16("Note Capacity"), kCapacity, nullptr, ParameterInfo::kIsList);
+	for (int32 i = 0; i < num_capacity_steps; ++i)
+		capParam->appendString(capacity_name[i]);
+	capParam->getInfo().defaultNormalizedValue = normalize(step_of_capacity(default_note_capacity), num_capacity_steps - 1);
+	parameters.addParameter(capParam);
+
+	StringListParameter* lmParam = new StringListParameter(STR16("Load Model"), kLoadModel);
+	for (int32 i = 0; i < kNumLoadModels; ++i)
+		lmParam->appendString(load_model_name[i]);
+	lmParam->getInfo().defaultNormalizedValue = normalize(kLoadCount, kNumLoadModels - 1);
+	parameters.addParameter(lmParam);
+
+	for (int32 i = 0; i < num_cost_ranges * num_cost_bands; ++i)
+	{
+		const uint8 cost = default_cost_table[i / num_cost_bands][i % num_cost_bands];
+		RangeParameter* costParam = new RangeParameter(cost_name[i], kCostTable + i, nullptr, 1., max_note_cost, cost, max_note_cost - 1, 0);
+		costParam->getInfo().defaultNormalizedValue = normalize(cost - 1, max_note_cost - 1);
+		parameters.addParameter(costParam);
+	}
+
+	RangeParameter* gainParam = new RangeParameter(STR16("Feedback Gain"), kFeedbackGain, nullptr, 0., max_feedback_gain, 0., max_feedback_gain, 0);
+	gainParam->getInfo().defaultNormalizedValue = normalize(0, max_feedback_gain);
+	parameters.addParameter(gainParam);
+
+	RangeParameter* overloadParam = new RangeParameter(STR16("Overload Level"), kOverloadLevel, STR16("%"),
+		min_overload_percent, 100., default_overload_percent, num_overload_steps - 1, 0);
+	overloadParam->getInfo().defaultNormalizedValue =
+		normalize((default_overload_percent - min_overload_percent) / overload_percent_step, num_overload_steps - 1);
+	parameters.addParameter(overloadParam);
+
+	RangeParameter* releaseParam = new RangeParameter(STR16("Release Time"), kReleaseTime, STR16("s"), 0., max_release_ms / 1000., 0.);
+	releaseParam->setPrecision(1);
+	parameters.addParameter(releaseParam);
+
+	// Measured loads are fed back by automation (e.g. from a CPU meter on each instrument instance's track), one per
+	// output target, numbered 16 * bus + channel + 1.
+	TChar mlString[24] = STR16("Measured Load ");
+	const int32 mlPrefix = 14;
+	for (int32 t = 0; t < max_out_targets; ++t)
+	{
+		uint32_to_str16(mlString + mlPrefix, t + 1);
+		parameters.addParameter(new RangeParameter(mlString, kMeasuredLoad + t, STR16("%"), 0., 100., 0.));
+	}
+
+	// Zoned strategy key and velocity ranges, one of each per output channel
+	TChar zString[4][28] = { STR16("Zone Low Key "), STR16("Zone High Key "), STR16("Zone Low Velocity "), STR16("Zone High Velocity ") };
+	const int32 zPrefix[4] = { 13, 14, 18, 19 };
+	const ParamID zFirst[4] = { kZoneLowKey, kZoneHighKey, kZoneLowVelocity, kZoneHighVelocity };
+	for (int32 i = 0; i < 4; ++i)
+	{
+		for (int32 c = 0; c < max_out_channels; ++c)
+		{
+			uint32_to_str16(zString[i] + zPrefix[i], c + 1);
+			parameters.addParameter(new RangeParameter(zString[i], zFirst[i] + c, nullptr, 0., 127., (i % 2) ? 127. : 0., 127));
+		}
+	}
+	parameters.addParameter(new RangeParameter(STR16("Zone Spill"), kZoneSpill, nullptr, 0., max_zone_spill, 0., max_zone_spill));
+	parameters.addParameter(STR16("Share Load"), nullptr, 1, 0., ParameterInfo::kCanAutomate, kShareLoad);
+
+	// Voice limits, one per output channel (0 = no limit), and what to do with a note when every channel is at its limit
+	TChar pcString[24] = STR16("Polyphony Cap ");
+	const int32 pcPrefix = 14;
+	for (int32 c = 0; c < max_out_channels; ++c)
+	{
+		uint32_to_str16(pcString + pcPrefix, c + 1);
+		parameters.addParameter(new RangeParameter(pcString, kPolyphonyCap + c, nullptr, 0., max_polyphony_cap, 0., max_polyphony_cap));
+	}
+	StringListParameter* ofParam = new StringListParameter(STR16("Overflow"), kOverflow);
+	for (int32 i = 0; i < kNumOverflows; ++i)
+		ofParam->appendString(overflow_name[i]);
+	ofParam->getInfo().defaultNormalizedValue = normalize(kOverflowSteal, kNumOverflows - 1);
+	parameters.addParameter(ofParam);
+
+	// Relative capacity of each output channel's instrument instances, e.g. 2 on performance cores, 1 on efficiency cores
+	TChar cwString[24] = STR16("Capacity Weight ");
+	const int32 cwPrefix = 16;
+	for (int32 c = 0; c < max_out_channels; ++c)
+	{
+		uint32_to_str16(cwString + cwPrefix, c + 1);
+		parameters.addParameter(new RangeParameter(cwString, kChannelWeight + c, nullptr, 1., max_channel_weight, 1., max_channel_weight - 1));
+	}
+
+	RangeParameter* mpeLowerParam = new RangeParameter(STR16("MPE Lower Zone"), kMpeLowerMembers, nullptr, 0., max_mpe_members, 0., max_mpe_members);
+	parameters.addParameter(mpeLowerParam);
+	RangeParameter* mpeUpperParam = new RangeParameter(STR16("MPE Upper Zone"), kMpeUpperMembers, nullptr, 0., max_mpe_members, 0., max_mpe_members);
+	parameters.addParameter(mpeUpperParam);
+
+	// Pass-through channel messages of each input channel, mapped from MIDI by getMidiControllerAssignment
+	TChar cmString[kNumChannelMessages][24] = {
+		STR16("Pitch Bend "), STR16("Pressure "), STR16("Timbre "), STR16("Mod Wheel "), STR16("Breath "),
+		STR16("Foot "), STR16("Volume "), STR16("Pan "), STR16("Expression "), STR16("Soft Pedal ")
+	};
+	const int32 cmPrefix[kNumChannelMessages] = { 11, 9, 7, 10, 7, 5, 7, 4, 11, 11 };
+	for (int32 m = 0; m < kNumChannelMessages; ++m)
+	{
+		for (int32 c = 0; c < 16; ++c)
+		{
+			uint32_to_str16(cmString[m] + cmPrefix[m], c + 1);
+			parameters.addParameter(cmString[m], nullptr, channel_message_max[m],
+				(ParamValue)channel_message_default[m] / (ParamValue)channel_message_max[m], ParameterInfo::kIsHidden, kChannelMessage + m * 16 + c);
+		}
+	}
+
+	// Read-only meters the processor updates telemetry_rate times per second
+	const int32 meter = ParameterInfo::kIsReadOnly;
+	parameters.addParameter(new RangeParameter(STR16("Load Imbalance"), kLoadImbalance, STR16("%"), 0., 100., 0., 0, meter));
+	parameters.addParameter(new RangeParameter(STR16("Notes Per Second"), kNotesPerSecond, nullptr, 0., max_meter_rate, 0., 0, meter));
+	parameters.addParameter(new RangeParameter(STR16("Evictions Per Second"), kEvictionsPerSecond, nullptr, 0., max_meter_rate, 0., 0, meter));
+	parameters.addParameter(new RangeParameter(STR16("Pool Occupancy"), kPoolOccupancy, STR16("%"), 0., 100., 0., 0, meter));
+	parameters.addParameter(new RangeParameter(STR16("Worst Process Time"), kWorstProcessTime, STR16("us"), 0., max_meter_process_us, 0., 0, meter));
+
+	// Diagnostic log verbosity, starting from $SPREAD_LOG_LEVEL.  Not automatable: the processor is told by message,
+	// since starting the log writer is not real-time safe.
+	StringListParameter* llParam = new StringListParameter(STR16("Log Level"), kLogLevel, nullptr, ParameterInfo::kIsList);
+	for (int32 i = kLogOff; i <= kLogTrace; ++i)
+		llParam->appendString(log_level_name[i]);
+	const int32 level = log_level.load(std::memory_order_relaxed);
+	llParam->setNormalized(normalize((level < kLogOff) ? kLogOff : (level > kLogTrace) ? kLogTrace : level, kLogTrace));
+	parameters.addParameter(llParam);
+
 	LOG("SpreadController::initialize exited normally with code %d.\n", result);
 	return result;
 }
@@ -107,7 +247,7 @@ tresult PLUGIN_API SpreadController::setComponentState(IBStream* state)
 	LOG("SpreadController::setComponentState called.\n");
 	if (!state)
 	{
-		LOG("SpreadController::setComponentState failed because no state argument provided.\n");
+		LOG_ERROR("SpreadController::setComponentState failed because no state argument provided.\n");
 		return kResultFalse;
 	}
 
@@ -125,13 +265,185 @@ tresult PLUGIN_API SpreadController::setComponentState(IBStream* state)
 	else if ((loaded_strat < 0) || (loaded_strat >= kNumStrategies))
 		return kResultFalse;
 
+	int32 loaded_evict;
+	if (!streamer.readInt32(loaded_evict))
+		loaded_evict = kEvictOldest;
+	else if ((loaded_evict < 0) || (loaded_evict >= kNumEvictions))
+		return kResultFalse;
+
+	uint32 loaded_capacity;
+	if (!streamer.readInt32u(loaded_capacity))
+		loaded_capacity = default_note_capacity;
+	else if (loaded_capacity != capacity_of_step(step_of_capacity(loaded_capacity)))
+		return kResultFalse;
+
+	int32 loaded_model;
+	if (!streamer.readInt32(loaded_model))
+		loaded_model = kLoadCount;
+	else if ((loaded_model < 0) || (loaded_model >= kNumLoadModels))
+		return kResultFalse;
+
+	unsigned char loaded_costs[num_cost_ranges * num_cost_bands];
+	if (streamer.readRaw(loaded_costs, sizeof(loaded_costs)) != sizeof(loaded_costs))
+		memcpy(loaded_costs, default_cost_table, sizeof(loaded_costs));
+	for (int32 i = 0; i < num_cost_ranges * num_cost_bands; ++i)
+	{
+		if ((loaded_costs[i] < 1) || (loaded_costs[i] > max_note_cost))
+			return kResultFalse;
+	}
+
+	int32 loaded_gain;
+	if (!streamer.readInt32(loaded_gain))
+		loaded_gain = 0;
+	else if ((loaded_gain < 0) || (loaded_gain > max_feedback_gain))
+		return kResultFalse;
+
+	int32 loaded_overload;
+	if (!streamer.readInt32(loaded_overload))
+		loaded_overload = default_overload_percent;
+	else if ((loaded_overload < min_overload_percent) || (loaded_overload > 100) || (loaded_overload % overload_percent_step))
+		return kResultFalse;
+
+	int32 loaded_release;
+	if (!streamer.readInt32(loaded_release))
+		loaded_release = 0;
+	else if ((loaded_release < 0) || (loaded_release > max_release_ms))
+		return kResultFalse;
+
+	unsigned char loaded_ob;
+	if (!streamer.readUChar8(loaded_ob))
+		loaded_ob = 1;
+	else if ((loaded_ob < 1) || (loaded_ob > max_out_buses))
+		return kResultFalse;
+
+	uint64 loaded_seed, loaded_random;
+	unsigned char loaded_mpe_lower, loaded_mpe_upper;
+	if (!streamer.readInt64u(loaded_seed) || !streamer.readInt64u(loaded_random) || !streamer.readUChar8(loaded_mpe_lower))
+		loaded_mpe_lower = 0;
+	else if (loaded_mpe_lower > max_mpe_members)
+		return kResultFalse;
+	if (!streamer.readUChar8(loaded_mpe_upper))
+		loaded_mpe_upper = 0;
+	else if (loaded_mpe_upper > max_mpe_members)
+		return kResultFalse;
+
+	zone_range loaded_zones[max_out_channels];
+	if (streamer.readRaw(loaded_zones, sizeof(loaded_zones)) != sizeof(loaded_zones))
+	{
+		for (int16 c = 0; c < max_out_channels; ++c)
+			loaded_zones[c] = default_zone;
+	}
+	for (int16 c = 0; c < max_out_channels; ++c)
+	{
+		const zone_range& z = loaded_zones[c];
+		if ((z.low_key > 127) || (z.high_key > 127) || (z.low_velocity > 127) || (z.high_velocity > 127))
+			return kResultFalse;
+	}
+
+	unsigned char loaded_spill;
+	if (!streamer.readUChar8(loaded_spill))
+		loaded_spill = 0;
+	else if (loaded_spill > max_zone_spill)
+		return kResultFalse;
+
+	unsigned char loaded_share;
+	if (!streamer.readUChar8(loaded_share))
+		loaded_share = 0;
+
+	unsigned char loaded_caps[max_out_channels];
+	if (streamer.readRaw(loaded_caps, sizeof(loaded_caps)) != sizeof(loaded_caps))
+		memset(loaded_caps, 0, sizeof(loaded_caps));
+	for (int16 c = 0; c < max_out_channels; ++c)
+	{
+		if (loaded_caps[c] > max_polyphony_cap)
+			return kResultFalse;
+	}
+
+	unsigned char loaded_overflow;
+	if (!streamer.readUChar8(loaded_overflow))
+		loaded_overflow = kOverflowSteal;
+	else if (loaded_overflow >= kNumOverflows)
+		return kResultFalse;
+
+	unsigned char loaded_weights[max_out_channels];
+	if (streamer.readRaw(loaded_weights, sizeof(loaded_weights)) != sizeof(loaded_weights))
+		memset(loaded_weights, 1, sizeof(loaded_weights));
+	for (int16 c = 0; c < max_out_channels; ++c)
+	{
+		if ((loaded_weights[c] < 1) || (loaded_weights[c] > max_channel_weight))
+			return kResultFalse;
+	}
+
 	setParamNormalized(kOutChannels, normalize(loaded_oc, 16));
+	setParamNormalized(kOutBuses, normalize(loaded_ob - 1, max_out_buses - 1));
 	setParamNormalized(kStrategy, normalize(loaded_strat, kNumStrategies - 1));
+	setParamNormalized(kEviction, normalize(loaded_evict, kNumEvictions - 1));
+	setParamNormalized(kCapacity, normalize(step_of_capacity(loaded_capacity), num_capacity_steps - 1));
+	setParamNormalized(kLoadModel, normalize(loaded_model, kNumLoadModels - 1));
+	for (int32 i = 0; i < num_cost_ranges * num_cost_bands; ++i)
+		setParamNormalized(kCostTable + i, normalize(loaded_costs[i] - 1, max_note_cost - 1));
+	setParamNormalized(kFeedbackGain, normalize(loaded_gain, max_feedback_gain));
+	setParamNormalized(kReleaseTime, (ParamValue)loaded_release / (ParamValue)max_release_ms);
+	setParamNormalized(kOverloadLevel, normalize((loaded_overload - min_overload_percent) / overload_percent_step, num_overload_steps - 1));
+	setParamNormalized(kMpeLowerMembers, normalize(loaded_mpe_lower, max_mpe_members));
+	setParamNormalized(kMpeUpperMembers, normalize(loaded_mpe_upper, max_mpe_members));
+	for (int16 c = 0; c < max_out_channels; ++c)
+	{
+		setParamNormalized(kZoneLowKey + c, normalize(loaded_zones[c].low_key, 127));
+		setParamNormalized(kZoneHighKey + c, normalize(loaded_zones[c].high_key, 127));
+		setParamNormalized(kZoneLowVelocity + c, normalize(loaded_zones[c].low_velocity, 127));
+		setParamNormalized(kZoneHighVelocity + c, normalize(loaded_zones[c].high_velocity, 127));
+	}
+	setParamNormalized(kZoneSpill, normalize(loaded_spill, max_zone_spill));
+	setParamNormalized(kShareLoad, loaded_share ? 1. : 0.);
+	for (int16 c = 0; c < max_out_channels; ++c)
+		setParamNormalized(kPolyphonyCap + c, normalize(loaded_caps[c], max_polyphony_cap));
+	setParamNormalized(kOverflow, normalize(loaded_overflow, kNumOverflows - 1));
+	for (int16 c = 0; c < max_out_channels; ++c)
+		setParamNormalized(kChannelWeight + c, normalize(loaded_weights[c] - 1, max_channel_weight - 1));
 
 	LOG("SpreadController::setComponentState exited normally.\n");
 	return kResultOk;
 }
 
+tresult PLUGIN_API SpreadController::setParamNormalized(ParamID tag, ParamValue value)
+{
+	tresult result = EditController::setParamNormalized(tag, value);
+	if (tag == kLogLevel)
+	{
+		IPtr<IMessage> request = owned(allocateMessage());
+		if (request)
+		{
+			request->setMessageID(log_level_message_id);
+			request->getAttributes()->setInt(log_level_attribute, discretize(value, kLogTrace));
+			sendMessage(request);
+		}
+	}
+	else if ((tag >= kLoadImbalance) && (tag <= kWorstProcessTime))
+	{
+		// a meter just moved, so there is a fresh snapshot to ask for (the processor replies once per snapshot)
+		IPtr<IMessage> request = owned(allocateMessage());
+		if (request)
+		{
+			request->setMessageID(telemetry_request_id);
+			sendMessage(request);
+		}
+	}
+	return result;
+}
+
+tresult PLUGIN_API SpreadController::notify(IMessage* message)
+{
+	if (!message || strcmp(message->getMessageID(), telemetry_reply_id) != 0)
+		return EditController::notify(message);
+
+	const void* data;
+	uint32 size;
+	if ((message->getAttributes()->getBinary(telemetry_attribute, data, size) == kResultOk) && (size == sizeof(telemetry)))
+		memcpy(&telemetry, data, sizeof(telemetry));
+	return kResultOk;
+}
+
 tresult PLUGIN_API SpreadController::getMidiControllerAssignment(int32 busIndex, int16 midiChannel, CtrlNumber midiControllerNumber, ParamID& tag)
 {
 	LOG("SpreadController::getMidiControllerAssignment called.\n");
@@ -156,7 +468,18 @@ tresult PLUGIN_API SpreadController::getMidiControllerAssignment(int32 busIndex,
 			LOG("SpreadController::getMidiControllerAssignment registered kCtrlResetAllCtrlers.\n");
 			return kResultTrue;
 		}
+		if ((0 <= midiChannel) && (midiChannel < 16))
+		{
+			for (int32 m = 0; m < kNumChannelMessages; ++m)
+			{
+				if (midiControllerNumber == channel_message_cc[m])
+				{
+					tag = kChannelMessage + m * 16 + midiChannel;
+					return kResultTrue;
+				}
+			}
+		}
 	}
-	LOG("SpreadController:getMidiControllerAssignment exited with failure.\n");
+	LOG_ERROR("SpreadController:getMidiControllerAssignment exited with failure.\n");
 	return kResultFalse;
 }
@@ -2,6 +2,8 @@
 
 #include "public.sdk/source/vst/vsteditcontroller.h"
 
+#include "SpreadTelemetry.h"
+
 using namespace Steinberg;
 using namespace Steinberg::Vst;
 
@@ -26,6 +28,11 @@ public:
 
 	tresult PLUGIN_API setComponentState(IBStream* state) SMTG_OVERRIDE;
 	tresult PLUGIN_API getMidiControllerAssignment(int32 busIndex, int16 channel, CtrlNumber midiControllerNumber, ParamID& id) SMTG_OVERRIDE;
+	tresult PLUGIN_API setParamNormalized(ParamID tag, ParamValue value) SMTG_OVERRIDE;
+	tresult PLUGIN_API notify(IMessage* message) SMTG_OVERRIDE;
+
+	// Newest full telemetry snapshot from the processor, for a view to display
+	const spread_telemetry& get_telemetry(void) const { return telemetry; }
 
 	// Uncomment to add a GUI
 	// IPlugView * PLUGIN_API createView (const char * name);
@@ -38,5 +45,8 @@ public:
 	// tresult PLUGIN_API getParamValueByString(ParamID tag, TChar* string, ParamValue& valueNormalized);
 
 	~SpreadController(void);
+
+protected:
+	spread_telemetry telemetry = {};
 };
 
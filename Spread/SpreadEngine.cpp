@@ -0,0 +1,1543 @@
+#include <cstdlib>
+#include <cstring>
+
+#include "SpreadEngine.h"
+#include "SpreadStrategy.h"
+
+SpreadEngine::SpreadEngine(void)
+{
+	for (int16_t pitch = 0; pitch < 128; ++pitch)
+		held_head[pitch] = held_tail[pitch] = -1;
+	memcpy(cost_table, default_cost_table, sizeof(cost_table));
+	for (int16_t c = 0; c < 16; ++c)
+	{
+		member_target[c] = -1;
+		for (int32_t m = 0; m < kNumChannelMessages; ++m)
+			channel_value[c][m] = channel_message_default[m];
+	}
+	for (int16_t t = 0; t < max_out_targets; ++t)
+		memcpy(sent_value[t], channel_message_default, sizeof(sent_value[t]));
+	for (int16_t c = 0; c < max_out_channels; ++c)
+	{
+		zones[c] = default_zone;
+		channel_weight[c] = 1;
+	}
+	rebuild_zones();
+	rebuild_weights();
+	rng.seed(seed);
+	refresh_loads();
+	rebuild_evict();
+	rebuild_targets();
+	select_router();
+	allocate_pool();
+}
+
+SpreadEngine::~SpreadEngine(void)
+{
+	set_load_board(nullptr);
+	if (note_pool)
+	{
+		free(note_pool);
+		note_pool = nullptr;
+		pool_size = 0;
+	}
+}
+
+void SpreadEngine::reset(void)
+{
+	counter = 0;
+	rng.seed(seed);
+}
+
+bool SpreadEngine::allocate_pool(void)
+{
+	// Each held note can leave at most one tail in each stage before its slot is reused, so twice the note capacity
+	// covers all but very rapid retriggering; beyond that the oldest tails are retired early.
+	if (full_tails.capacity() != 2 * capacity)
+	{
+		clear_tails();
+		if (!full_tails.allocate(2 * capacity) || !half_tails.allocate(2 * capacity))
+			return false;
+	}
+	return ((uint32_t)pool_size == capacity) || resize_pool(capacity);
+}
+
+void SpreadEngine::compact_pool(void)
+{
+	clear_tails();
+	full_tails.allocate(0);
+	half_tails.allocate(0);
+	if ((uint32_t)pool_size > held_count)
+		resize_pool(held_count);
+}
+
+// Moves the held notes, oldest first, into a new pool with the given number of slots, re-adding them so that every
+// chain and index is rebuilt compactly.  If there are more held notes than slots, the oldest are forgotten.
+bool SpreadEngine::resize_pool(uint32_t slots)
+{
+	note_in_record* new_pool = nullptr;
+	if (slots > 0)
+	{
+		new_pool = (note_in_record*)malloc(slots * sizeof(*new_pool));
+		if (!new_pool)
+			return false;
+	}
+	note_index new_index, new_id_index;
+	if (!new_index.allocate(slots) || !new_id_index.allocate(slots))
+	{
+		free(new_pool);
+		return false;
+	}
+
+	note_in_record* const old_pool = note_pool;
+	note_pool_index j = oldest;
+	for (uint32_t skip = (held_count > slots) ? (held_count - slots) : 0; skip > 0; --skip)
+		j = old_pool[j].newer;
+
+	note_pool = new_pool;
+	pool_size = (note_pool_index)slots;
+	free_list = 0;
+	for (note_pool_index i = 0; i < pool_size; ++i)
+		note_pool[i].next = i + 1;
+	for (int16_t pitch = 0; pitch < 128; ++pitch)
+		held_head[pitch] = held_tail[pitch] = -1;
+	held_pitches[0] = held_pitches[1] = 0;
+	held_index.swap(new_index);
+	id_index.swap(new_id_index);
+	oldest = newest = -1;
+	held_count = 0;
+	for (int16_t t = 0; t < max_out_targets; ++t)
+		cstate[t].load = cstate[t].held = 0;
+	rebuild_evict();
+	rebuild_targets();
+
+	spread_event e = {};
+	e.type = kSpreadNoteOn;
+	for (; j >= 0; j = old_pool[j].newer)
+	{
+		const note_in_record& note = old_pool[j];
+		e.noteId = note.noteId;
+		e.pitch = note.pitch;
+		e.channel = note.in_channel;
+		e.velocity = (float)note.velocity / 127.F;
+		add_note(e, note.out_target, nullptr);
+	}
+	free(old_pool);
+	refresh_loads();
+	return true;
+}
+
+inline void SpreadEngine::update_load(int16_t target)
+{
+	if (is_active(target))
+	{
+		// a target at its voice limit drops out of the running
+		const int16_t i = active_index(target);
+		const uint64_t bit = 1ULL << (i % 64);
+		if (capped && is_full(target))
+		{
+			if (tree_live)
+				min_load.update(i, min_load.excluded);
+			full[i / 64] |= bit;
+		}
+		else
+		{
+			if (tree_live)
+				min_load.update(i, load_key(target));
+			full[i / 64] &= ~bit;
+		}
+	}
+	if (board)
+		publish_load(target);
+}
+
+// Sets every active target's key in min_load from its current load, rebuilding the tree once rather than per target.
+void SpreadEngine::rebuild_min_load(void)
+{
+	min_load.resize(num_active());
+	for (int16_t n = 0; n < num_active(); ++n)
+		min_load.set(n, (full[n / 64] & (1ULL << (n % 64))) ? min_load.excluded : load_key(nth_active(n)));
+	min_load.rebuild();
+}
+
+// Tells the other engines on the board how this engine's load on a target changed.
+inline void SpreadEngine::publish_load(int16_t target)
+{
+	out_channel_state& c = cstate[target];
+	const uint32_t own = c.load + c.susload + c.tail;
+	if (own != c.published)
+	{
+		board->add((uint32_t)target, (int32_t)(own - c.published));
+		c.published = own;
+	}
+}
+
+// Refreshes what the other engines on the board have on each active target.  Once per block is enough: the board
+// only has to keep instances from piling onto the same targets, not track every note of every other instance.
+void SpreadEngine::sync_board(void)
+{
+	for (int16_t n = 0; n < num_active(); ++n)
+	{
+		const int16_t t = nth_active(n);
+		out_channel_state& c = cstate[t];
+		const uint32_t total = board->total((uint32_t)t);
+		const uint32_t others = (total > c.published) ? (total - c.published) : 0;
+		if (others != c.shared)
+		{
+			c.shared = others;
+			update_load(t);
+		}
+	}
+}
+
+void SpreadEngine::set_load_board(load_board<max_out_targets>* b)
+{
+	if (b == board)
+		return;
+	for (int16_t t = 0; t < max_out_targets; ++t)
+	{
+		if (board && cstate[t].published)
+			board->add((uint32_t)t, -(int32_t)cstate[t].published);
+		cstate[t].published = 0;
+		cstate[t].shared = 0;
+	}
+	board = b;
+	for (int16_t t = 0; t < max_out_targets; ++t)
+		update_load(t);
+	if (board)
+		sync_board();
+}
+
+void SpreadEngine::update_bias(int16_t target)
+{
+	out_channel_state& c = cstate[target];
+	const float overload = (float)overload_percent / 100.F;
+	if (c.measured >= overload)
+		c.drained = true;
+	else if (c.measured < overload - overload_hysteresis)
+		c.drained = false;
+	c.bias = (uint32_t)(c.measured * (float)feedback_gain + 0.5F) + (c.drained ? drained_load : 0);
+	update_load(target);
+}
+
+void SpreadEngine::set_measured_load(int16_t target, float measured)
+{
+	cstate[target].measured = (measured <= 0.F) ? 0.F : (measured >= 1.F) ? 1.F : measured;
+	update_bias(target);
+}
+
+void SpreadEngine::set_feedback_gain(int32_t g)
+{
+	feedback_gain = g;
+	for (int16_t t = 0; t < max_out_targets; ++t)
+		update_bias(t);
+}
+
+void SpreadEngine::set_overload_percent(int32_t p)
+{
+	overload_percent = p;
+	for (int16_t t = 0; t < max_out_targets; ++t)
+		update_bias(t);
+}
+
+void SpreadEngine::refresh_loads(void)
+{
+	min_load.resize(num_active());
+	full[0] = full[1] = 0;
+	for (int16_t n = 0; n < num_active(); ++n)
+		update_load(nth_active(n));
+	if (board)
+	{
+		// targets that just left the spread may have lost their sustain load
+		for (int16_t t = 0; t < max_out_targets; ++t)
+			publish_load(t);
+	}
+}
+
+inline uint8_t SpreadEngine::note_cost(int16_t pitch, uint8_t velocity) const
+{
+	if (load_model != kLoadWeighted)
+		return 1;
+	const int32_t range = (pitch > cost_range_top[0]) + (pitch > cost_range_top[1]) + (pitch > cost_range_top[2]);
+	const int32_t band = (velocity > cost_band_top[0]) + (velocity > cost_band_top[1]) + (velocity > cost_band_top[2]);
+	return cost_table[range][band];
+}
+
+inline int16_t SpreadEngine::release_load(const note_in_record& note)
+{
+	const int16_t pitch = note.pitch;
+	const int16_t out_target = note.out_target;
+	cstate[out_target].load = (cstate[out_target].load > note.cost) ? (cstate[out_target].load - note.cost) : 0;
+	if (cstate[out_target].held > 0)
+		--cstate[out_target].held;
+	const bool latched = (soslocked[pitch / 64] & (1ULL << (pitch % 64))) != 0;
+	if ((sustain_pedal_down || latched) && is_active(out_target))
+	{
+		// a note the sostenuto pedal latched is let go with that pedal, whatever the sustain pedal does meanwhile
+		cstate[out_target].susload += note.cost;
+		++cstate[out_target].sustained;
+		if (latched)
+		{
+			cstate[out_target].sosload += note.cost;
+			++cstate[out_target].latched;
+		}
+	}
+	else
+		add_tail(out_target, note.cost);
+	update_load(out_target);
+	return out_target;
+}
+
+// Starts a release tail of the given cost on a target.  The caller updates the target's load afterwards.
+inline void SpreadEngine::add_tail(int16_t target, uint32_t cost)
+{
+	if ((half_release <= 0) || (full_tails.capacity() == 0))
+		return;
+	while (cost > 0)
+	{
+		if (full_tails.full())
+			advance_tail();	// out of room: move the oldest tail on to its second stage early
+		// costs are stored in bytes, so a heavy sustain-pedal release may take several entries
+		const uint8_t c = (cost > 255) ? 255 : (uint8_t)cost;
+		full_tails.push({ now + half_release, target, c });
+		cstate[target].tail += c;
+		cost -= c;
+	}
+}
+
+// Moves the oldest first-stage tail to the second stage, dropping half of its cost.
+inline void SpreadEngine::advance_tail(void)
+{
+	const tail_entry e = full_tails.front();
+	full_tails.pop();
+	const uint8_t remaining = (uint8_t)((e.cost + 1) / 2);
+	cstate[e.target].tail -= e.cost - remaining;
+	if (half_tails.full())
+		retire_tail();
+	half_tails.push({ e.deadline + half_release, e.target, remaining });
+	update_load(e.target);
+}
+
+// Stops counting the oldest second-stage tail.
+inline void SpreadEngine::retire_tail(void)
+{
+	const tail_entry& e = half_tails.front();
+	cstate[e.target].tail -= e.cost;
+	update_load(e.target);
+	half_tails.pop();
+}
+
+// Retires tail stages whose time has passed.  Cheap when none have: only the queue fronts are examined.
+inline void SpreadEngine::expire_tails(void)
+{
+	while (!full_tails.empty() && (full_tails.front().deadline <= now))
+		advance_tail();
+	while (!half_tails.empty() && (half_tails.front().deadline <= now))
+		retire_tail();
+}
+
+bool SpreadEngine::is_idle(void) const
+{
+	if ((held_count > 0) || !full_tails.empty() || !half_tails.empty())
+		return false;
+	for (int16_t t = 0; t < max_out_targets; ++t)
+	{
+		if (cstate[t].susload > 0)
+			return false;
+	}
+	return true;
+}
+
+void SpreadEngine::clear_tails(void)
+{
+	full_tails.clear();
+	half_tails.clear();
+	for (int16_t t = 0; t < max_out_targets; ++t)
+		cstate[t].tail = 0;
+	refresh_loads();
+}
+
+void SpreadEngine::set_release_ms(int32_t ms)
+{
+	if (ms != release_ms)
+	{
+		// tails already queued were timed for the old release, and later ones could overtake them; start afresh
+		release_ms = ms;
+		half_release = (int64_t)(sample_rate * (double)ms / 2000.);
+		clear_tails();
+	}
+}
+
+void SpreadEngine::advance_clock(int32_t samples)
+{
+	// tails that ended during the block stop counting now, not at the next note-on
+	sample_clock += samples;
+	now = sample_clock;
+	expire_tails();
+	if (board)
+		sync_board();
+}
+
+void SpreadEngine::set_sample_rate(double rate)
+{
+	if (rate != sample_rate)
+	{
+		sample_rate = rate;
+		half_release = (int64_t)(sample_rate * (double)release_ms / 2000.);
+		clear_tails();
+	}
+}
+
+int16_t SpreadEngine::delete_note(note_pool_index j, int32_t* noteId, note_index_entry* e)
+{
+	if ((j < 0) || (j >= pool_size))
+		return -1;
+
+	note_in_record& note = note_pool[j];
+	const int16_t pitch = note.pitch;
+	const int16_t out_target = release_load(note);
+
+	if (noteId)
+		*noteId = note.noteId;
+
+	// unlink from the note-on order list and the eviction index
+	if (note.older >= 0)
+		note_pool[note.older].newer = note.newer;
+	else
+		oldest = note.newer;
+	if (note.newer >= 0)
+		note_pool[note.newer].older = note.older;
+	else
+		newest = note.older;
+	unlink_evict(j, evict_bucket(note));
+	if ((eviction == kEvictStacked) && (note.next < 0) && (note.prev >= 0))
+		unlink_evict(note.prev, 0);	// the note struck before this one on its pitch is no longer stacked
+	update_busiest(out_target);
+	if (capped)
+	{
+		if (note.prev_on_target >= 0)
+			note_pool[note.prev_on_target].next_on_target = note.next_on_target;
+		else
+			target_head[out_target] = note.next_on_target;
+		if (note.next_on_target >= 0)
+			note_pool[note.next_on_target].prev_on_target = note.prev_on_target;
+		else
+			target_tail[out_target] = note.prev_on_target;
+	}
+
+	// unlink from the pitch chain
+	if (note.prev >= 0)
+		note_pool[note.prev].next = note.next;
+	else
+		held_head[pitch] = note.next;
+	if (note.next >= 0)
+		note_pool[note.next].prev = note.prev;
+	else
+		held_tail[pitch] = note.prev;
+	if (held_head[pitch] < 0)
+		held_pitches[pitch / 64] &= ~(1ULL << (pitch % 64));
+
+	// unlink from the chain of notes sharing its key, dropping the key once no note has it
+	if ((note.prev_same < 0) || (note.next_same < 0))
+	{
+		if (!e)
+			e = held_index.find(pitch, note.in_channel, note.noteId);
+		if (note.prev_same < 0)
+			e->head = note.next_same;
+		if (note.next_same < 0)
+			e->tail = note.prev_same;
+		if (e->head < 0)
+			held_index.erase(e);
+	}
+	if (note.prev_same >= 0)
+		note_pool[note.prev_same].next_same = note.next_same;
+	if (note.next_same >= 0)
+		note_pool[note.next_same].prev_same = note.prev_same;
+
+	// likewise for the chain of notes sharing its noteId
+	if (id_indexed && (note.noteId >= 0) && ((note.prev_id < 0) || (note.next_id < 0)))
+	{
+		note_index_entry* const id_e = id_index.find(0, 0, note.noteId);
+		if (note.prev_id < 0)
+			id_e->head = note.next_id;
+		if (note.next_id < 0)
+			id_e->tail = note.prev_id;
+		if (id_e->head < 0)
+			id_index.erase(id_e);
+	}
+	if (id_indexed && (note.noteId >= 0))
+	{
+		if (note.prev_id >= 0)
+			note_pool[note.prev_id].next_id = note.next_id;
+		if (note.next_id >= 0)
+			note_pool[note.next_id].prev_id = note.prev_id;
+	}
+
+	note.next = free_list;
+	free_list = j;
+	--held_count;
+
+	return out_target;
+}
+
+int16_t SpreadEngine::target_of_note(bool delete_it, int16_t pitch, int32_t noteId, int16_t in_channel)
+{
+	// The oldest held note with a matching key is the one addressed.
+	note_index_entry* const e = held_index.find(pitch, in_channel, noteId);
+	if (!e)
+		return -1;
+	return delete_it ? delete_note(e->head, nullptr, e) : note_pool[e->head].out_target;
+}
+
+inline int16_t SpreadEngine::evict_bucket(const note_in_record& note) const
+{
+	switch (eviction)
+	{
+	case kEvictQuietest:
+		return note.velocity;
+	case kEvictBusiest:
+		return note.out_target;
+	case kEvictStacked:
+		return (note.next >= 0) ? 0 : -1;
+	}
+	return -1;
+}
+
+inline void SpreadEngine::link_evict(note_pool_index j, int16_t bucket)
+{
+	if (bucket < 0)
+		return;
+	note_in_record& note = note_pool[j];
+	note.prev_evict = evict_tail[bucket];
+	note.next_evict = -1;
+	if (note.prev_evict >= 0)
+		note_pool[note.prev_evict].next_evict = j;
+	else
+	{
+		evict_head[bucket] = j;
+		evict_nonempty[bucket / 64] |= 1ULL << (bucket % 64);
+	}
+	evict_tail[bucket] = j;
+}
+
+inline void SpreadEngine::unlink_evict(note_pool_index j, int16_t bucket)
+{
+	if (bucket < 0)
+		return;
+	const note_in_record& note = note_pool[j];
+	if (note.prev_evict >= 0)
+		note_pool[note.prev_evict].next_evict = note.next_evict;
+	else
+		evict_head[bucket] = note.next_evict;
+	if (note.next_evict >= 0)
+		note_pool[note.next_evict].prev_evict = note.prev_evict;
+	else
+		evict_tail[bucket] = note.prev_evict;
+	if (evict_head[bucket] < 0)
+		evict_nonempty[bucket / 64] &= ~(1ULL << (bucket % 64));
+}
+
+inline void SpreadEngine::update_busiest(int16_t target)
+{
+	if (eviction == kEvictBusiest)
+		busiest.update(target, (evict_head[target] >= 0) ? (busiest.excluded - 1 - cstate[target].load) : busiest.excluded);
+}
+
+// Rebuilds the eviction index of the current policy from the note-on order list.
+void SpreadEngine::rebuild_evict(void)
+{
+	for (int16_t bucket = 0; bucket < 128; ++bucket)
+		evict_head[bucket] = evict_tail[bucket] = -1;
+	evict_nonempty[0] = evict_nonempty[1] = 0;
+	for (note_pool_index j = oldest; j >= 0; j = note_pool[j].newer)
+	{
+		if (eviction == kEvictStacked)
+		{
+			// a note became stacked when the next note on its pitch was struck
+			if (note_pool[j].prev >= 0)
+				link_evict(note_pool[j].prev, 0);
+		}
+		else
+			link_evict(j, evict_bucket(note_pool[j]));
+	}
+	if (eviction == kEvictBusiest)
+	{
+		busiest.resize(max_out_targets);
+		for (int16_t t = 0; t < max_out_targets; ++t)
+			update_busiest(t);
+	}
+}
+
+// Appends a note to the list of notes held on its target.
+inline void SpreadEngine::link_target(note_pool_index j)
+{
+	note_in_record& note = note_pool[j];
+	const int16_t target = note.out_target;
+	note.prev_on_target = target_tail[target];
+	note.next_on_target = -1;
+	if (target_tail[target] >= 0)
+		note_pool[target_tail[target]].next_on_target = j;
+	else
+		target_head[target] = j;
+	target_tail[target] = j;
+}
+
+// Appends a held note with a noteId to the chain of notes sharing it.
+inline void SpreadEngine::link_id(note_pool_index j)
+{
+	note_in_record& note = note_pool[j];
+	note_index_entry* const e = id_index.insert(0, 0, note.noteId);
+	note.prev_id = e->tail;
+	note.next_id = -1;
+	if (e->tail >= 0)
+		note_pool[e->tail].next_id = j;
+	else
+		e->head = j;
+	e->tail = j;
+}
+
+// Rebuilds the lists of notes held on each target from the note-on order list, if they are needed.
+void SpreadEngine::rebuild_targets(void)
+{
+	for (int16_t t = 0; t < max_out_targets; ++t)
+		target_head[t] = target_tail[t] = -1;
+	if (capped)
+	{
+		for (note_pool_index j = oldest; j >= 0; j = note_pool[j].newer)
+			link_target(j);
+	}
+}
+
+void SpreadEngine::set_eviction(int32_t policy)
+{
+	if (policy != eviction)
+	{
+		eviction = policy;
+		rebuild_evict();
+	}
+}
+
+note_pool_index SpreadEngine::evict_victim(void) const
+{
+	switch (eviction)
+	{
+	case kEvictQuietest:
+		if (evict_nonempty[0])
+			return evict_head[lowest_bit(evict_nonempty[0])];
+		else if (evict_nonempty[1])
+			return evict_head[64 + lowest_bit(evict_nonempty[1])];
+		break;
+
+	case kEvictBusiest:
+		if (busiest.min_load() != busiest.excluded)
+			return evict_head[busiest.select(0)];
+		break;
+
+	case kEvictStacked:
+		if (evict_head[0] >= 0)
+			return evict_head[0];
+		break;
+	}
+	return oldest;
+}
+
+// Releases a held note early to make room for another, sending its note-off at the new note's position.
+bool SpreadEngine::evict_note(spread_output* out, note_pool_index victim, const spread_event& note_on_event)
+{
+	const int16_t pitch = note_pool[victim].pitch;
+	int32_t id;
+	const int16_t out_target = delete_note(victim, &id);
+	if (out_target < 0)
+		return false;
+
+	spread_event evt = {};
+	evt.sampleOffset = note_on_event.sampleOffset;
+	evt.ppqPosition = note_on_event.ppqPosition;
+	evt.tag = -1;
+	evt.type = kSpreadNoteOff;
+	set_target(evt, out_target);
+	evt.noteId = id;
+	evt.pitch = pitch;
+	evt.velocity = 1.F;
+	emit(out, evt);
+
+	++eviction_count;
+	return true;
+}
+
+bool SpreadEngine::emergency_evict(spread_output* out, const spread_event& note_on_event)
+{
+	if (out)
+	{
+		const note_pool_index victim = evict_victim();
+		return (victim >= 0) && evict_note(out, victim, note_on_event);
+	}
+	else
+		return false;
+}
+
+bool SpreadEngine::add_note(const spread_event& note_on_event, int16_t out_target, spread_output* out)
+{
+	if ((free_list >= pool_size) && !emergency_evict(out, note_on_event))
+		return false;
+
+	const note_pool_index slot = free_list;
+	if (slot >= pool_size)
+		return false;
+	note_in_record& note = note_pool[slot];
+	free_list = note.next;
+	note.noteId = note_on_event.noteId;
+	note.pitch = (uint8_t)note_on_event.pitch;
+	note.in_channel = (uint8_t)note_on_event.channel;
+	note.out_target = (uint8_t)out_target;
+	const float velocity = note_on_event.velocity * 127.F + 0.5F;
+	note.velocity = (velocity <= 0.F) ? 0 : (velocity >= 127.F) ? 127 : (uint8_t)velocity;
+	note.cost = note_cost(note_on_event.pitch, note.velocity);
+
+	// append to the note-on order list
+	note.older = newest;
+	note.newer = -1;
+	if (newest >= 0)
+		note_pool[newest].newer = slot;
+	else
+		oldest = slot;
+	newest = slot;
+
+	// append to the pitch chain
+	const int16_t pitch = note_on_event.pitch;
+	note.prev = held_tail[pitch];
+	note.next = -1;
+	if (note.prev >= 0)
+		note_pool[note.prev].next = slot;
+	else
+	{
+		held_head[pitch] = slot;
+		held_pitches[pitch / 64] |= 1ULL << (pitch % 64);
+	}
+	held_tail[pitch] = slot;
+
+	// append to the chain of notes sharing its key
+	note_index_entry* const e = held_index.insert(pitch, note_on_event.channel, note_on_event.noteId);
+	note.prev_same = e->tail;
+	note.next_same = -1;
+	if (e->tail >= 0)
+		note_pool[e->tail].next_same = slot;
+	else
+		e->head = slot;
+	e->tail = slot;
+
+	// append to the chain of notes sharing its noteId, once note expressions have asked for it
+	if (id_indexed && (note.noteId >= 0))
+		link_id(slot);
+
+	// add to the eviction index
+	link_evict(slot, evict_bucket(note));
+	if ((eviction == kEvictStacked) && (note.prev >= 0))
+		link_evict(note.prev, 0);	// the note struck before this one on its pitch is now stacked
+	if (capped)
+		link_target(slot);
+
+	++held_count;
+	cstate[out_target].load += note.cost;
+	++cstate[out_target].held;
+	update_load(out_target);
+	update_busiest(out_target);
+
+	return true;
+}
+
+void SpreadEngine::resize_spread(spread_output* out, int16_t new_oc, int16_t new_ob, int32_t offset)
+{
+	const int16_t old_oc = out_channels, old_ob = out_buses;
+	if (sustain_pedal_down)
+	{
+		spread_event e = {};
+		e.type = kSpreadControlChange;
+		e.tag = -1;
+		e.sampleOffset = offset;
+		e.controlNumber = kSpreadCtrlSustainOnOff;
+
+		for (int16_t t = 0; t < max_out_targets; ++t)
+		{
+			const bool was_active = (CHANNEL_OF_TARGET(t) < old_oc) && (BUS_OF_TARGET(t) < old_ob);
+			const bool now_active = (CHANNEL_OF_TARGET(t) < new_oc) && (BUS_OF_TARGET(t) < new_ob);
+			if (was_active != now_active)
+			{
+				// targets dropped from the output spread get pedal-off and lose their sustain load;
+				// targets added to the output spread get pedal-on
+				if (was_active)
+					cstate[t].susload = cstate[t].sosload = cstate[t].sustained = cstate[t].latched = 0;
+				e.value = now_active ? 127 : 0;
+				set_target(e, t);
+				emit(out, e);
+			}
+		}
+	}
+	out_channels = new_oc;
+	out_buses = new_ob;
+	rebuild_weights();
+	refresh_loads();
+	select_router();
+}
+
+void SpreadEngine::set_outchannels(spread_output* out, int16_t new_oc, int32_t offset)
+{
+	resize_spread(out, new_oc, out_buses, offset);
+}
+
+void SpreadEngine::set_outbuses(spread_output* out, int16_t new_ob, int32_t offset)
+{
+	resize_spread(out, out_channels, (new_ob < 1) ? 1 : new_ob, offset);
+}
+
+void SpreadEngine::broadcast_event(spread_output* out, uint8_t cc, uint8_t value, int32_t offset)
+{
+	if (out)
+	{
+		spread_event e = {};
+		e.type = kSpreadControlChange;
+		e.tag = -1;
+		e.sampleOffset = offset;
+		e.controlNumber = cc;
+		e.value = (int8_t)value;
+		for (int16_t n = 0; n < num_active(); ++n)
+		{
+			set_target(e, nth_active(n));
+			emit(out, e);
+		}
+	}
+}
+
+void SpreadEngine::press_sustain_pedal(spread_output* out, int32_t offset)
+{
+	if (!sustain_pedal_down)
+	{
+		sustain_pedal_down = true;
+		broadcast_event(out, kSpreadCtrlSustainOnOff, 127, offset);
+	}
+}
+
+void SpreadEngine::release_sustain_pedal(spread_output* out, int32_t offset)
+{
+	if (sustain_pedal_down)
+	{
+		sustain_pedal_down = false;
+		now = sample_clock + offset;
+		const bool live = tree_live;
+		tree_live = false;	// every target may change, so rebuild min_load once afterwards
+		for (int16_t n = 0; n < num_active(); ++n)
+		{
+			// the notes the pedal was holding now begin their release tails, except those the sostenuto pedal holds
+			const int16_t t = nth_active(n);
+			out_channel_state& c = cstate[t];
+			const uint32_t released = c.susload - c.sosload;
+			c.susload = c.sosload;
+			c.sustained = c.latched;
+			add_tail(t, released);
+			update_load(t);
+		}
+		tree_live = live;
+		if (live)
+			rebuild_min_load();
+		broadcast_event(out, kSpreadCtrlSustainOnOff, 0, offset);
+	}
+}
+
+void SpreadEngine::press_sostenuto_pedal(spread_output* out, int32_t offset)
+{
+	if (!sostenuto_pedal_down)
+	{
+		sostenuto_pedal_down = true;
+		broadcast_event(out, kSpreadCtrlSostenutoOnOff, 127, offset);
+	}
+
+	soslocked[0] |= held_pitches[0];
+	soslocked[1] |= held_pitches[1];
+}
+
+void SpreadEngine::release_sostenuto_pedal(spread_output* out, int32_t offset)
+{
+	if (sostenuto_pedal_down)
+	{
+		sostenuto_pedal_down = false;
+		broadcast_event(out, kSpreadCtrlSostenutoOnOff, 0, offset);
+	}
+
+	soslocked[0] = soslocked[1] = 0;
+	now = sample_clock + offset;
+	for (int16_t n = 0; n < num_active(); ++n)
+	{
+		// the notes the pedal latched begin their release tails, unless the sustain pedal now holds them
+		const int16_t t = nth_active(n);
+		out_channel_state& c = cstate[t];
+		if (c.latched == 0)
+			continue;
+		if (!sustain_pedal_down)
+		{
+			c.susload -= c.sosload;
+			c.sustained = (uint16_t)(c.sustained - c.latched);
+			add_tail(t, c.sosload);
+		}
+		c.sosload = 0;
+		c.latched = 0;
+		update_load(t);
+	}
+}
+
+void SpreadEngine::set_zone(int16_t channel, const zone_range& z)
+{
+	zones[channel] = z;
+	rebuild_zones();
+}
+
+void SpreadEngine::rebuild_zones(void)
+{
+	for (int16_t i = 0; i < 128; ++i)
+	{
+		uint16_t keys = 0, velocities = 0;
+		for (int16_t c = 0; c < max_out_channels; ++c)
+		{
+			if ((zones[c].low_key <= i) && (i <= zones[c].high_key))
+				keys |= (uint16_t)(1u << c);
+			if ((zones[c].low_velocity <= i) && (i <= zones[c].high_velocity))
+				velocities |= (uint16_t)(1u << c);
+		}
+		key_owners[i] = keys;
+		velocity_owners[i] = velocities;
+	}
+}
+
+void SpreadEngine::set_channel_weight(int16_t channel, uint8_t weight)
+{
+	channel_weight[channel] = (weight < 1) ? 1 : (weight > max_channel_weight) ? (uint8_t)max_channel_weight : weight;
+	rebuild_weights();
+	refresh_loads();
+}
+
+// Lays out the order in which Round Robin and Random visit the active channels, by smooth weighted round-robin: each
+// step credits every channel with its weight and visits the most credited, which then pays back the total.  Visits are
+// spread evenly, and each channel is visited as often as its weight (divided by the weights' common factor) per period.
+void SpreadEngine::rebuild_weights(void)
+{
+	uint8_t common = 0;
+	weighted = false;
+	for (int16_t c = 0; c < out_channels; ++c)
+	{
+		uint8_t a = channel_weight[c], b = common;
+		while (b)
+		{
+			const uint8_t r = (uint8_t)(a % b);
+			a = b;
+			b = r;
+		}
+		common = a;
+		weighted = weighted || (channel_weight[c] != channel_weight[0]);
+	}
+
+	int32_t credit[max_out_channels] = {};
+	int32_t total = 0;
+	for (int16_t c = 0; c < out_channels; ++c)
+		total += channel_weight[c] / common;
+	weight_period = (int16_t)total;
+	for (int16_t i = 0; i < weight_period; ++i)
+	{
+		int16_t best = 0;
+		for (int16_t c = 0; c < out_channels; ++c)
+		{
+			credit[c] += channel_weight[c] / common;
+			if (credit[c] > credit[best])
+				best = c;
+		}
+		credit[best] -= total;
+		weight_order[i] = (uint8_t)best;
+	}
+}
+
+int16_t SpreadEngine::zoned_target(int16_t pitch, uint8_t velocity)
+{
+	const uint16_t active = (uint16_t)((1u << out_channels) - 1);
+	uint16_t owners = key_owners[pitch] & velocity_owners[velocity] & active;
+	if (!owners)
+		owners = active;
+
+	// the owning channels' targets on every active bus, least loaded first
+	int16_t candidates[max_out_targets];
+	int16_t n;
+	uint32_t least;
+	for (;;)
+	{
+		n = 0;
+		least = UINT32_MAX;
+		for (uint64_t bits = owners; bits; bits &= bits - 1)
+		{
+			const int16_t c = (int16_t)lowest_bit(bits);
+			for (int16_t b = 0; b < out_buses; ++b)
+			{
+				const int16_t t = TARGET_OF(b, c);
+				if (capped && is_full(t))
+					continue;
+				const uint32_t key = load_key(t);
+				if (key < least)
+				{
+					least = key;
+					n = 0;
+				}
+				if (key == least)
+					candidates[n++] = t;
+			}
+		}
+		if ((n == 0) && (owners != active))
+			owners = active;	// every owner is at its voice limit
+		else if ((zone_spill <= 0) || (least < (uint32_t)zone_spill * (weighted ? weighted_key_unit : 1)) || (owners == active))
+			break;
+		else
+			owners = (uint16_t)((owners | (owners << 1) | (owners >> 1)) & active);	// spill into the neighbouring zones
+	}
+	if (n == 0)
+		return -1;
+
+	// rotate through the targets tied for the lowest load
+	++counter;
+	return candidates[counter % n];
+}
+
+float SpreadEngine::get_imbalance(void) const
+{
+	// compares loads per unit of weight, so weighted channels are balanced when their loads follow their weights
+	const int16_t n = num_active();
+	double most = 0.;
+	double total = 0.;
+	double weights = 0.;
+	for (int16_t i = 0; i < n; ++i)
+	{
+		const int16_t t = nth_active(i);
+		const double weight = weighted ? (double)channel_weight[CHANNEL_OF_TARGET(t)] : 1.;
+		const double load = (double)(cstate[t].load + cstate[t].susload + cstate[t].tail);
+		total += load;
+		weights += weight;
+		if (load / weight > most)
+			most = load / weight;
+	}
+	return (most == 0.) ? 0.F : 1.F - (float)(total / weights / most);
+}
+
+void SpreadEngine::set_mpe_zones(int16_t lower, int16_t upper)
+{
+	mpe_lower = lower;
+	mpe_upper = upper;
+
+	// the lower zone takes precedence; the upper zone gets whatever channels remain
+	const int16_t upper_members = (lower > 0) ? ((upper < 14 - lower) ? upper : (int16_t)(14 - lower)) : upper;
+	for (int16_t c = 0; c < 16; ++c)
+		mpe_role[c] = kMpeNone;
+	if (lower > 0)
+	{
+		mpe_role[0] = kMpeMaster;
+		for (int16_t c = 1; c <= lower; ++c)
+			mpe_role[c] = kMpeMember;
+	}
+	if (upper_members > 0)
+	{
+		mpe_role[15] = kMpeMaster;
+		for (int16_t c = 15 - upper_members; c < 15; ++c)
+			mpe_role[c] = kMpeMember;
+	}
+}
+
+void SpreadEngine::channel_message(spread_output* out, int16_t in_channel, int32_t message, uint16_t value, int32_t offset, double pos)
+{
+	if ((in_channel < 0) || (in_channel >= 16) || (message < 0) || (message >= kNumChannelMessages))
+		return;
+	channel_value[in_channel][message] = value;
+
+	if (bypass || (out_channels <= 0))
+	{
+		// notes keep their input channels, and so do their controllers
+		send_message(out, in_channel, message, value, offset, pos);
+		return;
+	}
+	if (mpe_role[in_channel] == kMpeMember)
+	{
+		// per-note, so it follows the channel's newest note (which may already be releasing)
+		if (member_target[in_channel] >= 0)
+			send_message(out, member_target[in_channel], message, value, offset, pos);
+		return;
+	}
+
+	// Channel-wide, so every instance needs it, but idle ones only get it just before their next note, and then the
+	// value from that note's own input channel.  That keeps controller floods from waking instances that have nothing
+	// to play, and keeps CC 7 on one input channel from overwriting CC 7 on another for notes still to come.
+	if (!out)
+		return;
+	for (int16_t t = 0; t < max_out_targets; ++t)
+	{
+		if (is_active(t) && is_sounding(t))
+			send_message(out, t, message, value, offset, pos);
+	}
+}
+
+inline void SpreadEngine::send_message(spread_output* out, int16_t target, int32_t message, uint16_t value, int32_t offset, double pos)
+{
+	if (out)
+	{
+		spread_event e = {};
+		e.sampleOffset = offset;
+		e.ppqPosition = pos;
+		e.tag = -1;
+		set_target(e, target);
+		set_channel_message(e, message, value);
+		emit(out, e);
+		sent_value[target][message] = value;
+	}
+}
+
+// Brings a target's controllers up to date just before it is sent a note, with the values from the note's input
+// channel: the channel-wide messages it was spared while idle or last got from another input channel, then, for a
+// note on an MPE member channel, that channel's per-note messages (which MPE controllers send before the note-on, when
+// the note's target was not yet known) over the zone master's channel-wide ones.
+void SpreadEngine::replay_messages(spread_output* out, int16_t target, int16_t in_channel, int32_t offset, double pos)
+{
+	const bool member = (mpe_role[in_channel] == kMpeMember);
+	const int16_t source = member ? ((in_channel <= mpe_lower) ? 0 : 15) : in_channel;
+	if (member)
+		member_target[in_channel] = target;
+	for (int32_t m = 0; m < kNumChannelMessages; ++m)
+	{
+		const int16_t from = (member && (m < num_mpe_messages)) ? in_channel : source;
+		const uint16_t value = channel_value[from][m];
+		if (sent_value[target][m] != value)
+			send_message(out, target, m, value, offset, pos);
+	}
+}
+
+void SpreadEngine::set_strategy(int32_t s)
+{
+	strategy = s;
+	select_router();
+}
+
+// Chooses the routing kernel once per strategy or spread change, so that note_on does not have to.
+void SpreadEngine::select_router(void)
+{
+	if (bypass || (out_channels <= 0) || (strategy < 0) || (strategy >= kNumStrategies))
+	{
+		router = nullptr;
+		load_aware = false;
+		tree_live = false;
+		return;
+	}
+	const strategy_kernels& k = strategy_table[strategy];
+	router = k.route[capped ? 1 : 0][channel_kernel(out_channels)];
+	load_aware = k.load_aware;
+	if (k.reads_tree && !tree_live)
+	{
+		// min_load went stale while no router read it
+		tree_live = true;
+		rebuild_min_load();
+	}
+	tree_live = k.reads_tree;
+}
+
+void SpreadEngine::set_polyphony_cap(int16_t channel, uint8_t cap)
+{
+	polyphony_cap[channel] = (cap > max_polyphony_cap) ? (uint8_t)max_polyphony_cap : cap;
+	const bool was_capped = capped;
+	capped = false;
+	for (int16_t c = 0; c < max_out_channels; ++c)
+		capped = capped || (polyphony_cap[c] != 0);
+	if (capped && !was_capped)
+		rebuild_targets();	// the per-target lists were not kept while uncapped
+	select_router();
+	refresh_loads();
+}
+
+// Picks a target for a note-on that found every target at its voice limit, per the overflow policy, or returns -1 to
+// drop the note.
+int16_t SpreadEngine::overflow_target(spread_output* out, const spread_event& note_on_event)
+{
+	if (overflow == kOverflowDrop)
+		return -1;
+
+	int16_t target = nth_active(0);
+	for (int16_t n = 1; n < num_active(); ++n)
+	{
+		const int16_t t = nth_active(n);
+		if (load_key(t) < load_key(target))
+			target = t;
+	}
+
+	if ((overflow == kOverflowSteal) && out)
+	{
+		// the target's oldest held note makes way; notes only the pedals are holding cannot be stolen
+		if (target_head[target] >= 0)
+			evict_note(out, target_head[target], note_on_event);
+	}
+	return target;
+}
+
+bool SpreadEngine::note_on(spread_output* out, spread_event& evt)
+{
+	const int16_t in_channel = evt.channel;
+	const int16_t pitch = evt.pitch;
+	if ((0 <= in_channel) && (in_channel < 16) && (0 <= pitch) && (pitch < 128))
+	{
+		now = sample_clock + evt.sampleOffset;
+		expire_tails();
+
+		int16_t out_target = router ? router(*this, evt) : in_channel;
+		if (out_target < 0)
+		{
+			// every target is at its voice limit
+			out_target = overflow_target(out, evt);
+			if (out_target < 0)
+				return true;	// dropped; its note-off will find no note and be ignored
+		}
+
+		if (!add_note(evt, out_target, out))
+			return false;
+		++note_on_count;
+
+		if (router)
+			replay_messages(out, out_target, in_channel, evt.sampleOffset, evt.ppqPosition);
+		set_target(evt, out_target);
+		emit(out, evt);
+	}
+	return true;
+}
+
+// Greedy least-loaded assignment is only balanced if the heaviest notes are placed first (longest-processing-time
+// order), so for the load-aware strategies a chord's notes are routed in descending order of cost, keeping their input
+// order among equal costs.  Under the note-count model every cost is equal and the chord is routed as it arrived.
+bool SpreadEngine::chord_on(spread_output* out, spread_event* events, uint32_t count)
+{
+	uint8_t order[max_chord_notes];
+	uint8_t cost[max_chord_notes];
+	if (count > max_chord_notes)
+		count = max_chord_notes;
+	const bool balance = router && load_aware && (load_model == kLoadWeighted);
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		uint32_t j = i;
+		if (balance)
+		{
+			const float velocity = events[i].velocity * 127.F + 0.5F;
+			const int16_t pitch = events[i].pitch;
+			cost[i] = ((pitch < 0) || (pitch >= 128)) ? 0
+				: note_cost(pitch, (velocity <= 0.F) ? 0 : (velocity >= 127.F) ? 127 : (uint8_t)velocity);
+			for (; (j > 0) && (cost[order[j - 1]] < cost[i]); --j)
+				order[j] = order[j - 1];
+		}
+		order[j] = (uint8_t)i;
+	}
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		if (!note_on(out, events[order[i]]))
+			return false;
+	}
+	return true;
+}
+
+void SpreadEngine::note_off(spread_output* out, spread_event& evt)
+{
+	const int16_t in_channel = evt.channel;
+	const int16_t pitch = evt.pitch;
+	if ((0 <= in_channel) && (in_channel < 16) && (0 <= pitch) && (pitch < 128))
+	{
+		now = sample_clock + evt.sampleOffset;
+		const int16_t out_target = target_of_note(true, pitch, evt.noteId, in_channel);
+		if (out_target >= 0)
+		{
+			set_target(evt, out_target);
+			emit(out, evt);
+		}
+		// Note-off without preceding note-on is ignored.
+	}
+}
+
+void SpreadEngine::polypressure(spread_output* out, spread_event& evt)
+{
+	int16_t in_channel = evt.channel;
+	int16_t pitch = evt.pitch;
+	if (out && (0 <= in_channel) && (in_channel < 16) && (0 <= pitch) && (pitch < 128))
+	{
+		const int16_t out_target = target_of_note(false, pitch, evt.noteId, in_channel);
+		if (out_target >= 0)
+		{
+			set_target(evt, out_target);
+			emit(out, evt);
+		}
+		// Poly-pressure without preceding note-on is ignored.
+	}
+}
+
+void SpreadEngine::note_expression(spread_output* out, spread_event& evt)
+{
+	// Note expressions carry only a noteId, so they go to the target of the oldest held note with that ID.  Most hosts
+	// never send them, so the noteId index is only built, from the note-on order list, when the first one arrives.
+	if (out && (evt.noteId >= 0))
+	{
+		if (!id_indexed)
+		{
+			id_index.clear();
+			for (note_pool_index j = oldest; j >= 0; j = note_pool[j].newer)
+			{
+				if (note_pool[j].noteId >= 0)
+					link_id(j);
+			}
+			id_indexed = true;
+		}
+		const note_index_entry* const e = id_index.find(0, 0, evt.noteId);
+		if (e)
+		{
+			set_target(evt, note_pool[e->head].out_target);
+			emit(out, evt);
+		}
+		// Expressions for notes not held are dropped.
+	}
+}
+
+void SpreadEngine::release_all(spread_output* out, int32_t offset, double pos, uint8_t cc)
+{
+	if (out)
+	{
+		spread_event evt = {};
+		evt.sampleOffset = offset;
+		evt.ppqPosition = pos;
+		evt.tag = -1;
+		evt.type = kSpreadNoteOff;
+		evt.velocity = 1.F;
+		now = sample_clock + offset;
+
+		// Every note goes, so rather than unlinking notes one at a time, return each held pitch's chain to the free
+		// list whole and drop the key index afterwards.  Likewise min_load is rebuilt once at the end.
+		const bool live = tree_live;
+		tree_live = false;
+		for (int16_t w = 0; w < 2; ++w)
+		{
+			for (uint64_t bits = held_pitches[w]; bits; bits &= bits - 1)
+			{
+				const int16_t pitch = (int16_t)(64 * w + lowest_bit(bits));
+				const note_pool_index head = held_head[pitch];
+				evt.pitch = pitch;
+				for (note_pool_index i = head; i >= 0; i = note_pool[i].next)
+				{
+					set_target(evt, release_load(note_pool[i]));
+					evt.noteId = note_pool[i].noteId;
+					emit(out, evt);
+				}
+				note_pool[held_tail[pitch]].next = free_list;
+				free_list = head;
+				held_head[pitch] = held_tail[pitch] = -1;
+			}
+			held_pitches[w] = 0;
+		}
+		held_index.clear();
+		if (id_indexed)
+			id_index.clear();
+		oldest = newest = -1;
+		held_count = 0;
+		rebuild_evict();
+		rebuild_targets();
+		tree_live = live;
+		if (live)
+			rebuild_min_load();
+
+		evt.type = kSpreadControlChange;
+		evt.pitch = 0;
+		evt.noteId = 0;
+		evt.velocity = 0.F;
+		evt.controlNumber = cc;
+		evt.value = evt.value2 = 0;
+		if (out_channels <= 0)
+		{
+			// notes kept their input channels
+			for (int16_t c = 0; c < 16; ++c)
+			{
+				set_target(evt, c);
+				emit(out, evt);
+			}
+		}
+		else
+		{
+			for (int16_t n = 0; n < num_active(); ++n)
+			{
+				set_target(evt, nth_active(n));
+				emit(out, evt);
+			}
+		}
+	}
+}
+
+bool SpreadEngine::set_parameter(uint32_t id, double value, int32_t offset, double ppq, spread_output* out)
+{
+	switch (id)
+	{
+	case kOutChannels: // number of output channels changed
+		set_outchannels(out, discretize(value, max_out_channels), offset);
+		break;
+
+	case kOutBuses: // number of output buses changed
+		set_outbuses(out, (int16_t)(1 + discretize(value, max_out_buses - 1)), offset);
+		break;
+
+	case kStrategy: // note distribution strategy changed
+		set_strategy(discretize(value, kNumStrategies - 1));
+		break;
+
+	case kSustain: // sustain pedal changed
+		if (value > 0.)
+			press_sustain_pedal(out, offset);
+		else
+			release_sustain_pedal(out, offset);
+		break;
+
+	case kSostenuto: // sostenuto pedal changed
+		if (value > 0.)
+			press_sostenuto_pedal(out, offset);
+		else
+			release_sostenuto_pedal(out, offset);
+		break;
+
+	case kMuteAll: // release and un-sustain all notes
+		if (value < 0.5)
+		{
+			release_all(out, offset, ppq, kSpreadCtrlAllSoundsOff);
+			reset();
+			for (int16_t t = 0; t < max_out_targets; ++t)
+				cstate[t].susload = cstate[t].sosload = cstate[t].sustained = cstate[t].latched = 0;
+			clear_tails();	// sounds are cut, not released
+			return true;
+		}
+		break;
+
+	case kReleaseAll: // release all notes without un-sustaining
+		if (value < 0.5)
+		{
+			release_all(out, offset, ppq, kSpreadCtrlAllNotesOff);
+			reset();
+			return true;
+		}
+		break;
+
+	case kBypass: // bypass mode preserves channel without remapping
+		bypass = (value >= 0.5);
+		select_router();
+		break;
+
+	case kMpeLowerMembers: // MPE zone layout changed
+		set_mpe_zones((int16_t)discretize(value, max_mpe_members), mpe_upper);
+		break;
+
+	case kMpeUpperMembers:
+		set_mpe_zones(mpe_lower, (int16_t)discretize(value, max_mpe_members));
+		break;
+
+	case kZoneSpill: // load at which a zone spills into its neighbours changed
+		zone_spill = discretize(value, max_zone_spill);
+		break;
+
+	case kShareLoad: // balancing against the other instances turned on or off
+		set_share_load(value >= 0.5);
+		break;
+
+	case kOverflow: // policy for notes that find every target at its voice limit changed
+		set_overflow(discretize(value, kNumOverflows - 1));
+		break;
+
+	case kEviction: // pool-exhaustion eviction policy changed
+		set_eviction(discretize(value, kNumEvictions - 1));
+		break;
+
+	case kCapacity: // note pool capacity changed; reallocating must wait until processing restarts
+		capacity = capacity_of_step(discretize(value, num_capacity_steps - 1));
+		break;
+
+	case kLoadModel: // note cost model changed; held notes keep the cost they were added with
+		load_model = discretize(value, kNumLoadModels - 1);
+		break;
+
+	case kReleaseTime: // release tail length changed
+		set_release_ms((int32_t)(value * (double)max_release_ms + 0.5));
+		break;
+
+	case kFeedbackGain: // measured-load feedback strength changed
+		set_feedback_gain(discretize(value, max_feedback_gain));
+		break;
+
+	case kOverloadLevel: // measured load at which a target is drained changed
+		set_overload_percent(min_overload_percent + overload_percent_step * discretize(value, num_overload_steps - 1));
+		break;
+
+	default:
+		if ((id >= kCostTable) && (id < kCostTable + num_cost_ranges * num_cost_bands))
+		{
+			const int32_t i = id - kCostTable;
+			cost_table[i / num_cost_bands][i % num_cost_bands] = (uint8_t)(1 + discretize(value, max_note_cost - 1));
+		}
+		else if ((id >= kMeasuredLoad) && (id < kMeasuredLoad + max_out_targets))
+			set_measured_load((int16_t)(id - kMeasuredLoad), (float)value);
+		else if ((id >= kZoneLowKey) && (id < kZoneHighVelocity + max_out_channels))
+		{
+			// zone bounds, four consecutive blocks of one per output channel
+			const int16_t c = (int16_t)((id - kZoneLowKey) % max_out_channels);
+			const uint8_t bound = (uint8_t)discretize(value, 127);
+			zone_range z = zones[c];
+			switch ((id - kZoneLowKey) / max_out_channels)
+			{
+			case 0: z.low_key = bound; break;
+			case 1: z.high_key = bound; break;
+			case 2: z.low_velocity = bound; break;
+			default: z.high_velocity = bound; break;
+			}
+			set_zone(c, z);
+		}
+		else if ((id >= kPolyphonyCap) && (id < kPolyphonyCap + max_out_channels))
+			set_polyphony_cap((int16_t)(id - kPolyphonyCap), (uint8_t)discretize(value, max_polyphony_cap));
+		else if ((id >= kChannelWeight) && (id < kChannelWeight + max_out_channels))
+			set_channel_weight((int16_t)(id - kChannelWeight), (uint8_t)(1 + discretize(value, max_channel_weight - 1)));
+		else if ((id >= kChannelMessage) && (id < kChannelMessage + kNumChannelMessages * 16))
+		{
+			const int32_t message = (int32_t)(id - kChannelMessage) / 16;
+			const uint16_t v = (uint16_t)(value * (double)channel_message_max[message] + 0.5);
+			channel_message(out, (int16_t)((id - kChannelMessage) % 16), message, v, offset, ppq);
+		}
+		break;
+	}
+	return false;
+}
+
+bool SpreadEngine::process_event(spread_event& evt, spread_output* out)
+{
+	switch (evt.type)
+	{
+	case kSpreadNoteOn:
+		return note_on(out, evt);
+	case kSpreadNoteOff:
+		note_off(out, evt);
+		break;
+	case kSpreadPolyPressure:
+		polypressure(out, evt);
+		break;
+	case kSpreadNoteExpression:
+		note_expression(out, evt);
+		break;
+	}
+	return true;
+}
+
+bool SpreadEngine::process_events(spread_event* events, uint32_t count, spread_output* out)
+{
+	for (uint32_t i = 0; i < count; )
+	{
+		// note-ons sharing a sample offset go as a chord
+		uint32_t n = 1;
+		while ((events[i].type == kSpreadNoteOn) && (i + n < count) && (n < max_chord_notes)
+			&& (events[i + n].type == kSpreadNoteOn) && (events[i + n].sampleOffset == events[i].sampleOffset))
+			++n;
+		if (!((n > 1) ? chord_on(out, events + i, n) : process_event(events[i], out)))
+			return false;
+		i += n;
+	}
+	return true;
+}
@@ -0,0 +1,635 @@
+#pragma once
+
+// Host-independent note distribution engine.  Nothing in this file depends on the VST3 SDK, so that the routing
+// logic can be built, profiled, and exercised outside of a plug-in host.
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "SpreadLoadBoard.h"
+#include "SpreadLoadTree.h"
+#include "SpreadNoteIndex.h"
+#include "SpreadRandom.h"
+#include "SpreadTailQueue.h"
+
+// Held-note capacities are powers of two from min_note_capacity to max_note_capacity.
+constexpr uint32_t min_note_capacity = 128;
+constexpr uint32_t default_note_capacity = 512;
+constexpr uint32_t max_note_capacity = 16384;
+constexpr int32_t num_capacity_steps = 8;	// log2(max_note_capacity / min_note_capacity) + 1
+constexpr int16_t max_out_channels = 16;	// per output bus
+constexpr int16_t max_out_buses = 8;
+
+// Output targets are numbered (bus << 4) | channel.
+constexpr int16_t max_out_targets = max_out_buses * max_out_channels;
+#define TARGET_OF(bus, channel) ((int16_t)(((bus) << 4) | (channel)))
+#define BUS_OF_TARGET(t) ((t) >> 4)
+#define CHANNEL_OF_TARGET(t) ((t) & 0xF)
+
+// Most events any single engine call can emit at any capacity (release_all: one note-off per held note plus one CC per
+// target, more than a full chord_on).  SpreadEngine::max_output_events gives the bound for the current capacity.
+constexpr uint32_t max_events_per_call = max_note_capacity + max_out_targets;
+
+// Parameter enumeration
+enum SpreadParams : uint32_t
+{
+	kOutChannels = 0,
+	kStrategy = 1,
+	kSustain = 2,
+	kSostenuto = 3,
+	kMuteAll = 4,
+	kReleaseAll = 5,
+	kBypass = 6,
+	kEviction = 7,
+	kCapacity = 8,	// takes effect at the next allocate_pool
+	kLoadModel = 9,
+	kCostTable = 10,	// first of num_cost_ranges * num_cost_bands consecutive cost parameters, by range then band
+	kFeedbackGain = 26,
+	kOverloadLevel = 27,
+	kMeasuredLoad = 28,	// first of max_out_targets consecutive measured-load inputs, by target
+	kReleaseTime = 156,
+	kOutBuses = 157,
+	kMpeLowerMembers = 158,	// member channels of the MPE lower zone (0 = no lower zone)
+	kMpeUpperMembers = 159,	// member channels of the MPE upper zone (0 = no upper zone)
+	kChannelMessage = 160,	// first of kNumChannelMessages * 16 consecutive MIDI-mapped inputs, by message then input channel
+	kZoneLowKey = 320,		// first of max_out_channels consecutive zone bounds, by output channel, for each of these four
+	kZoneHighKey = 336,
+	kZoneLowVelocity = 352,
+	kZoneHighVelocity = 368,
+	kZoneSpill = 384,
+	kLoadImbalance = 385,	// read-only telemetry from here on
+	kNotesPerSecond = 386,
+	kEvictionsPerSecond = 387,
+	kPoolOccupancy = 388,
+	kWorstProcessTime = 389,	// last of the read-only telemetry
+	kShareLoad = 390,	// balance against the other instances' loads on the process-wide load board
+	kPolyphonyCap = 391,	// first of max_out_channels consecutive voice limits, by output channel
+	kOverflow = 407,
+	kChannelWeight = 408,	// first of max_out_channels consecutive capacity weights, by output channel
+	kLogLevel = 424,	// diagnostic log verbosity; the controller passes it to the processor as a message
+	kNumParams = 425
+};
+
+enum Strategy : int32_t
+{
+	kMinLoad = 0,
+	kRoundRobin = 1,
+	kRandom = 2,
+	kTwoChoices = 3,	// the less loaded of two random targets
+	kZoned = 4,			// the least loaded target of the output channels whose zones contain the note
+	kNumStrategies = 5
+};
+
+// Which held note is released to make room when a note-on arrives with the note pool full
+enum Eviction : int32_t
+{
+	kEvictOldest = 0,
+	kEvictQuietest = 1,		// lowest note-on velocity, oldest first among equals
+	kEvictBusiest = 2,		// oldest note on the output target with the highest load
+	kEvictStacked = 3,		// a note whose pitch has since been struck again, longest-superseded first, else the oldest note
+	kNumEvictions = 4
+};
+
+// How much each held note adds to its output target's load
+enum LoadModel : int32_t
+{
+	kLoadCount = 0,		// every note costs 1
+	kLoadWeighted = 1,	// notes cost what the cost table says for their pitch range and velocity band
+	kNumLoadModels = 2
+};
+
+// Cost table dimensions.  Pitch ranges end at the given top pitches, velocity bands at the given top velocities.
+constexpr int32_t num_cost_ranges = 4;
+constexpr int32_t num_cost_bands = 4;
+constexpr int16_t cost_range_top[num_cost_ranges] = { 35, 59, 83, 127 };
+constexpr uint8_t cost_band_top[num_cost_bands] = { 40, 80, 110, 127 };
+constexpr uint8_t max_note_cost = 16;
+constexpr uint8_t default_cost_table[num_cost_ranges][num_cost_bands] = {
+	{ 3, 4, 5, 6 },	// bass: longer samples
+	{ 2, 3, 4, 5 },
+	{ 2, 2, 3, 4 },
+	{ 1, 2, 2, 3 }	// treble
+};
+
+// Closed-loop balancing.  Each target's measured load (0-1, e.g. the CPU share of the instrument instance it feeds)
+// adds up to max_feedback_gain load units to its MinLoad key, scaled by the feedback gain.  A target whose measured
+// load reaches the overload level is drained (only chosen if every target is) until it falls overload_hysteresis
+// below that level.
+constexpr int32_t max_feedback_gain = 32;
+constexpr int32_t min_overload_percent = 50;
+constexpr int32_t overload_percent_step = 5;
+constexpr int32_t num_overload_steps = 11;	// 50% to 100%
+constexpr int32_t default_overload_percent = 90;
+constexpr float overload_hysteresis = 0.1F;
+constexpr uint32_t drained_load = 1u << 24;
+
+// Key and velocity zones for the Zoned strategy.  Each output channel (on every active bus) owns the notes within its
+// key range and velocity range, so each instrument instance only ever needs its own part of a sample set.  A note no
+// zone owns may go to any channel.  If every target owning a note has at least the spill load, the note spills into
+// the neighbouring channels' zones, one channel further out at a time.  A spill load of 0 never spills.
+typedef struct {
+	uint8_t low_key, high_key;
+	uint8_t low_velocity, high_velocity;
+} zone_range;
+
+constexpr zone_range default_zone = { 0, 127, 0, 127 };
+constexpr int32_t max_zone_spill = 64;
+
+// Voice limits.  Each output channel can be given the most notes its instrument instances should be sent at once,
+// counting held notes and notes sustained by the pedals but not release tails (0 = no limit).  No strategy picks a
+// target at its limit; a note that finds every target full is handled by the overflow policy.
+constexpr int32_t max_polyphony_cap = 128;
+
+enum Overflow : int32_t
+{
+	kOverflowSteal = 0,		// release the oldest held note on the least loaded target and play the new note there
+	kOverflowExceed = 1,	// play on the least loaded target anyway, leaving the instrument to steal a voice
+	kOverflowDrop = 2,		// drop the note; its note-off is then ignored
+	kNumOverflows = 3
+};
+
+// Capacity weights.  Each output channel's instrument instances can be given a weight in proportion to how much work
+// they can take, e.g. 2 for those on performance cores and 1 for those on efficiency cores.  The load-aware strategies
+// then compare loads (and the zone spill load) per unit of weight, and Round Robin and Random visit each channel in
+// proportion to its weight.
+// If every active channel has the same weight, the weights have no effect.
+constexpr int32_t max_channel_weight = 16;
+constexpr uint32_t weighted_key_unit = 256;	// MinLoad key of one load unit per unit of weight; resolves every ratio
+
+// Release tails.  A released note keeps its full cost on its target for the first half of the release time and half
+// of it (rounded up) for the second half, approximating a decaying release envelope.  0 disables tail accounting.
+constexpr int32_t max_release_ms = 10000;
+constexpr double default_sample_rate = 44100.;
+
+// MIDI controller numbers the engine emits or reacts to.  Numbers above 127 stand for channel messages, as in VST3.
+enum SpreadControllers : uint8_t
+{
+	kSpreadCtrlModWheel = 1,
+	kSpreadCtrlBreath = 2,
+	kSpreadCtrlFoot = 4,
+	kSpreadCtrlVolume = 7,
+	kSpreadCtrlPan = 10,
+	kSpreadCtrlExpression = 11,
+	kSpreadCtrlSustainOnOff = 64,
+	kSpreadCtrlSostenutoOnOff = 66,
+	kSpreadCtrlSoftPedalOnOff = 67,
+	kSpreadCtrlTimbre = 74,
+	kSpreadCtrlAllSoundsOff = 120,
+	kSpreadCtrlAllNotesOff = 123,
+	kSpreadCtrlChannelPressure = 128,
+	kSpreadCtrlPitchBend = 129
+};
+
+// MPE (MIDI Polyphonic Expression) zones.  The lower zone's master channel is the first input channel and its member
+// channels follow it upwards; the upper zone's master channel is the last and its members precede it.  If the zones
+// would overlap, the upper zone shrinks to fit, as when an MPE Configuration Message redefines the lower zone.
+constexpr int16_t max_mpe_members = 15;
+
+// Per-channel messages passed through to the output targets, in kChannelMessage parameter order.  The first
+// num_mpe_messages are MPE's per-note dimensions.
+enum ChannelMessage : int32_t
+{
+	kMessagePitchBend = 0,	// 0-16383
+	kMessagePressure = 1,	// 0-127
+	kMessageTimbre = 2,		// CC 74, 0-127
+	kMessageModWheel = 3,
+	kMessageBreath = 4,
+	kMessageFoot = 5,
+	kMessageVolume = 6,
+	kMessagePan = 7,
+	kMessageExpression = 8,
+	kMessageSoftPedal = 9,
+	kNumChannelMessages = 10
+};
+
+constexpr int32_t num_mpe_messages = 3;
+// The only controllers passed through: VST 3 delivers a CC only through a parameter mapped to it, and each one here is
+// 16 hidden parameters (one per input channel), so the set is limited to those that shape a sounding note.
+constexpr uint8_t channel_message_cc[kNumChannelMessages] = {
+	kSpreadCtrlPitchBend, kSpreadCtrlChannelPressure, kSpreadCtrlTimbre, kSpreadCtrlModWheel, kSpreadCtrlBreath,
+	kSpreadCtrlFoot, kSpreadCtrlVolume, kSpreadCtrlPan, kSpreadCtrlExpression, kSpreadCtrlSoftPedalOnOff
+};
+constexpr uint16_t channel_message_max[kNumChannelMessages] = { 16383, 127, 127, 127, 127, 127, 127, 127, 127, 127 };
+constexpr uint16_t channel_message_default[kNumChannelMessages] = { 8192, 0, 64, 0, 0, 0, 100, 64, 127, 0 };
+
+// Note-ons sharing a sample offset are assigned together by chord_on, up to max_chord_notes at a time.  Each can emit
+// an eviction note-off, its target's channel message replay, and itself.
+constexpr uint32_t max_chord_notes = 64;
+constexpr uint32_t max_chord_events = max_chord_notes * (2 + kNumChannelMessages);
+
+enum SpreadEventType : uint8_t
+{
+	kSpreadNoteOn = 0,
+	kSpreadNoteOff = 1,
+	kSpreadPolyPressure = 2,
+	kSpreadNoteExpression = 3,	// value or text expression, addressed by noteId alone; the payload is opaque to the engine
+	kSpreadControlChange = 4	// output only
+};
+
+// A plain MIDI event.  On input, channel is the input channel; on output, bus and channel are the output target.
+typedef struct {
+	double ppqPosition;
+	int32_t sampleOffset;
+	int32_t tag;			// caller-defined; outputs derived from an input event copy its tag, generated outputs get -1
+	int32_t noteId;
+	float velocity;			// note-on/note-off velocity or poly-pressure amount
+	int16_t channel;
+	int16_t pitch;
+	uint8_t bus;			// output only
+	uint8_t type;			// SpreadEventType
+	uint8_t controlNumber;	// kSpreadControlChange only
+	int8_t value, value2;	// kSpreadControlChange only
+} spread_event;
+
+// Caller-owned output buffer.  Events that do not fit are dropped.
+typedef struct {
+	spread_event* events;
+	uint32_t capacity;
+	uint32_t count;
+} spread_output;
+
+// -1 = none
+typedef int16_t note_pool_index;
+
+constexpr int32_t no_note_id = -1;	// noteId of a note the host gave no ID
+
+typedef struct {
+	int32_t noteId;
+	note_pool_index prev, next;				// neighbors in the chain of notes held on this pitch, oldest first
+	note_pool_index prev_same, next_same;	// neighbors among held notes with the same pitch, input channel, and noteId
+	note_pool_index prev_id, next_id;		// neighbors among held notes with the same noteId (only while id_indexed)
+	note_pool_index older, newer;			// neighbors among all held notes, in note-on order
+	note_pool_index prev_evict, next_evict;	// neighbors in the eviction bucket of the current policy
+	note_pool_index prev_on_target, next_on_target;	// neighbors among held notes on the same target (only while capped)
+	uint8_t pitch;
+	uint8_t in_channel;
+	uint8_t out_target;
+	uint8_t velocity;	// 0-127
+	uint8_t cost;		// load this note adds to out_target while held
+} note_in_record;
+
+typedef struct {
+	uint32_t load, susload;	// susload: released notes the pedals are still holding, including sosload
+	uint32_t sosload;	// the part of susload only the sostenuto pedal is holding
+	uint32_t tail;		// cost of released notes whose release tails are still sounding
+	uint32_t bias;		// measured-load feedback added to the MinLoad key, including drained_load if drained
+	uint32_t shared;	// other engines' load on this target, from the load board as of the last block
+	uint32_t published;	// this engine's load + susload + tail as last added to the load board
+	uint16_t held;		// notes held on this target
+	uint16_t sustained;	// released notes the pedals are still holding on this target, including latched
+	uint16_t latched;	// the part of sustained only the sostenuto pedal is holding
+	float measured;		// last measured load, 0-1
+	bool drained;
+} out_channel_state;
+
+enum MpeRole : uint8_t
+{
+	kMpeNone = 0,
+	kMpeMaster = 1,
+	kMpeMember = 2
+};
+
+class SpreadEngine;
+struct strategy_policy;
+typedef int16_t (*strategy_router)(SpreadEngine& e, const spread_event& evt);
+
+class SpreadEngine
+{
+	friend struct strategy_policy;
+
+public:
+	SpreadEngine(void);
+	~SpreadEngine(void);
+
+	void reset(void);	// restart the channel distribution sequence
+	uint64_t get_seed(void) const { return seed; }
+	void set_seed(uint64_t s) { seed = s; }	// applied by the next reset
+	uint64_t get_random_state(void) const { return rng.get_state(); }
+	void set_random_state(uint64_t s) { rng.set_state(s); }
+	// Where the distribution sequence stands: the random state, the tie-rotation counter, and the round-robin position.
+	// Not saved with the settings, but a replay has to start from it.
+	void get_sequence(uint64_t& random_state, uint32_t& tie_counter, int16_t& roundrobin) const
+	{
+		random_state = rng.get_state();
+		tie_counter = counter;
+		roundrobin = roundrobin_channel;
+	}
+	void set_sequence(uint64_t random_state, uint32_t tie_counter, int16_t roundrobin)
+	{
+		rng.set_state(random_state);
+		counter = tie_counter;
+		roundrobin_channel = roundrobin;
+	}
+	// What replay_messages works from, likewise needed by a replay: the latest value of each channel message by input
+	// channel, the values each target was last sent, and the target of each MPE member channel's newest note.
+	void get_channel_messages(uint16_t (&latest)[16][kNumChannelMessages],
+		uint16_t (&sent)[max_out_targets][kNumChannelMessages], int16_t (&members)[16]) const
+	{
+		memcpy(latest, channel_value, sizeof(latest));
+		memcpy(sent, sent_value, sizeof(sent));
+		memcpy(members, member_target, sizeof(members));
+	}
+	void set_channel_messages(const uint16_t (&latest)[16][kNumChannelMessages],
+		const uint16_t (&sent)[max_out_targets][kNumChannelMessages], const int16_t (&members)[16])
+	{
+		memcpy(channel_value, latest, sizeof(latest));
+		memcpy(sent_value, sent, sizeof(sent));
+		memcpy(member_target, members, sizeof(members));
+	}
+	// Whether nothing is sounding: no note held by a key or a pedal, and no release tail still counted
+	bool is_idle(void) const;
+
+	// Sizes the note pool to the configured capacity, keeping held notes (the oldest are dropped if they no longer
+	// fit).  Allocates, so call it before processing starts, never from the audio thread.  Returns false if out of
+	// memory, in which case the previous pool is kept.
+	bool allocate_pool(void);
+	// Shrinks the note pool to just the notes currently held, e.g. while processing is inactive.  Not real-time safe.
+	void compact_pool(void);
+
+	// Routes one input event, appending the resulting events to out.  Returns false on a fatal routing error.
+	bool process_event(spread_event& evt, spread_output* out);
+	// Routes a span of input events in order.  Returns false if any of them failed.
+	bool process_events(spread_event* events, uint32_t count, spread_output* out);
+	// Applies a parameter change.  Returns true if a momentary trigger (MuteAll, ReleaseAll) fired, in which case the
+	// caller should reset that parameter to its off value.
+	bool set_parameter(uint32_t id, double value, int32_t offset, double ppq, spread_output* out);
+
+	bool note_on(spread_output* out, spread_event& evt);
+	// Routes up to max_chord_notes note-ons that share a sample offset as one batch.  Returns false like note_on.
+	bool chord_on(spread_output* out, spread_event* events, uint32_t count);
+	void note_off(spread_output* out, spread_event& evt);
+	void polypressure(spread_output* out, spread_event& evt);
+	void note_expression(spread_output* out, spread_event& evt);
+	void channel_message(spread_output* out, int16_t in_channel, int32_t message, uint16_t value, int32_t offset, double pos);
+	void release_all(spread_output* out, int32_t offset, double pos, uint8_t cc);
+
+	void set_outchannels(spread_output* out, int16_t new_oc, int32_t offset);
+	void set_outbuses(spread_output* out, int16_t new_ob, int32_t offset);
+	void press_sustain_pedal(spread_output* out, int32_t offset);
+	void release_sustain_pedal(spread_output* out, int32_t offset);
+	void press_sostenuto_pedal(spread_output* out, int32_t offset);
+	void release_sostenuto_pedal(spread_output* out, int32_t offset);
+
+	int16_t get_outchannels(void) const { return out_channels; }
+	int16_t get_outbuses(void) const { return out_buses; }
+	int32_t get_strategy(void) const { return strategy; }
+	void set_strategy(int32_t s);
+	uint32_t get_capacity(void) const { return capacity; }
+	void set_capacity(uint32_t c) { capacity = c; }	// applied by the next allocate_pool
+	uint32_t max_output_events(void) const
+	{
+		const uint32_t most = (uint32_t)pool_size + max_out_targets;
+		return (most > max_chord_events) ? most : max_chord_events;
+	}
+	int32_t get_load_model(void) const { return load_model; }
+	void set_load_model(int32_t m) { load_model = m; }
+	uint8_t get_cost(int32_t range, int32_t band) const { return cost_table[range][band]; }
+	void set_cost(int32_t range, int32_t band, uint8_t cost) { cost_table[range][band] = cost; }
+	int32_t get_feedback_gain(void) const { return feedback_gain; }
+	void set_feedback_gain(int32_t g);
+	int32_t get_overload_percent(void) const { return overload_percent; }
+	void set_overload_percent(int32_t p);
+	float get_measured_load(int16_t target) const { return cstate[target].measured; }
+	// Whether a target is drained, which within the hysteresis band depends on its earlier measured loads.  Setting it
+	// (to restore a trace) takes effect with the next set_measured_load.
+	bool is_drained(int16_t target) const { return cstate[target].drained; }
+	void set_drained(int16_t target, bool drained) { cstate[target].drained = drained; }
+	void set_measured_load(int16_t target, float measured);
+	int32_t get_release_ms(void) const { return release_ms; }
+	void set_release_ms(int32_t ms);
+	double get_sample_rate(void) const { return sample_rate; }
+	void set_sample_rate(double rate);
+	// call once per block, after its events
+	void advance_clock(int32_t samples);
+	int16_t get_mpe_lower(void) const { return mpe_lower; }
+	int16_t get_mpe_upper(void) const { return mpe_upper; }
+	void set_mpe_zones(int16_t lower, int16_t upper);
+	const zone_range& get_zone(int16_t channel) const { return zones[channel]; }
+	void set_zone(int16_t channel, const zone_range& z);
+	int32_t get_zone_spill(void) const { return zone_spill; }
+	void set_zone_spill(int32_t spill) { zone_spill = spill; }
+	uint8_t get_polyphony_cap(int16_t channel) const { return polyphony_cap[channel]; }
+	void set_polyphony_cap(int16_t channel, uint8_t cap);
+	uint8_t get_channel_weight(int16_t channel) const { return channel_weight[channel]; }
+	void set_channel_weight(int16_t channel, uint8_t weight);
+	int32_t get_overflow(void) const { return overflow; }
+	void set_overflow(int32_t policy) { overflow = policy; }
+	int32_t get_eviction(void) const { return eviction; }
+	void set_eviction(int32_t policy);
+	bool is_sustain_pedal_down(void) const { return sustain_pedal_down; }
+	bool is_sostenuto_pedal_down(void) const { return sostenuto_pedal_down; }
+	bool is_bypassed(void) const { return bypass; }
+	bool is_sharing_load(void) const { return board != nullptr; }
+	void set_share_load(bool share) { set_load_board(share ? &load_board<max_out_targets>::process_board() : nullptr); }
+	// Balances against the other engines on the given board as well (nullptr to balance alone), withdrawing this
+	// engine's load from the board it used before.
+	void set_load_board(load_board<max_out_targets>* b);
+
+	// Telemetry
+	uint32_t get_load(int16_t target) const { return cstate[target].load; }
+	uint32_t get_susload(int16_t target) const { return cstate[target].susload; }
+	uint32_t get_tail(int16_t target) const { return cstate[target].tail; }
+	uint32_t get_held_count(void) const { return held_count; }
+	uint32_t get_note_on_count(void) const { return note_on_count; }
+	uint32_t get_eviction_count(void) const { return eviction_count; }
+	float get_imbalance(void) const;
+
+protected:
+	inline bool is_active(int16_t target) const
+	{
+		return (CHANNEL_OF_TARGET(target) < out_channels) && (BUS_OF_TARGET(target) < out_buses);
+	}
+	inline int16_t num_active(void) const { return out_channels * out_buses; }
+	inline int16_t nth_active(int16_t n) const { return TARGET_OF(n / out_channels, n % out_channels); }
+	inline int16_t active_index(int16_t target) const { return BUS_OF_TARGET(target) * out_channels + CHANNEL_OF_TARGET(target); }
+	inline uint32_t load_key(int16_t target) const
+	{
+		const uint32_t key = cstate[target].load + cstate[target].susload + cstate[target].tail + cstate[target].bias + cstate[target].shared;
+		return weighted ? weigh_load(target, key) : key;
+	}
+	inline uint32_t weigh_load(int16_t target, uint32_t key) const
+	{
+		// load per unit of weight; a drained target stays behind every undrained one
+		const uint32_t penalty = cstate[target].drained ? drained_load : 0;
+		const uint64_t per_weight = (uint64_t)(key - penalty) * weighted_key_unit / channel_weight[CHANNEL_OF_TARGET(target)];
+		return ((per_weight < drained_load) ? (uint32_t)per_weight : (drained_load - 1)) + penalty;
+	}
+	void rebuild_weights(void);
+	inline void update_load(int16_t target);
+	void rebuild_min_load(void);
+	inline bool is_full(int16_t target) const
+	{
+		const uint8_t cap = polyphony_cap[CHANNEL_OF_TARGET(target)];
+		return cap && ((uint32_t)cstate[target].held + cstate[target].sustained >= cap);
+	}
+	int16_t overflow_target(spread_output* out, const spread_event& note_on_event);
+	inline void publish_load(int16_t target);
+	void sync_board(void);
+	void update_bias(int16_t target);
+	void refresh_loads(void);
+	void rebuild_zones(void);
+	int16_t zoned_target(int16_t pitch, uint8_t velocity);
+	void select_router(void);
+	void resize_spread(spread_output* out, int16_t new_oc, int16_t new_ob, int32_t offset);
+
+	inline uint8_t note_cost(int16_t pitch, uint8_t velocity) const;
+	inline int16_t release_load(const note_in_record& note); // returns out_target of note
+	inline void add_tail(int16_t target, uint32_t cost);
+	inline void advance_tail(void);
+	inline void retire_tail(void);
+	inline void expire_tails(void);
+	void clear_tails(void);
+	int16_t delete_note(note_pool_index j, int32_t* noteId, note_index_entry* e = nullptr); // returns out_target of deleted note
+	bool add_note(const spread_event& note_on_event, int16_t out_target, spread_output* out);
+	int16_t target_of_note(bool delete_it, int16_t pitch, int32_t noteId, int16_t in_channel);
+	bool evict_note(spread_output* out, note_pool_index victim, const spread_event& note_on_event);
+	bool emergency_evict(spread_output* out, const spread_event& note_on_event);
+	inline void link_target(note_pool_index j);
+	void rebuild_targets(void);
+	inline void link_id(note_pool_index j);
+	inline int16_t evict_bucket(const note_in_record& note) const;
+	inline void link_evict(note_pool_index j, int16_t bucket);
+	inline void unlink_evict(note_pool_index j, int16_t bucket);
+	inline void update_busiest(int16_t target);
+	void rebuild_evict(void);
+	bool resize_pool(uint32_t slots);
+	note_pool_index evict_victim(void) const;
+	void broadcast_event(spread_output* out, uint8_t cc, uint8_t value, int32_t offset);
+	inline bool is_sounding(int16_t target) const
+	{
+		return (cstate[target].load + cstate[target].susload + cstate[target].tail) > 0;
+	}
+	inline void send_message(spread_output* out, int16_t target, int32_t message, uint16_t value, int32_t offset, double pos);
+	void replay_messages(spread_output* out, int16_t target, int16_t in_channel, int32_t offset, double pos);
+
+	out_channel_state cstate[max_out_targets] = {};
+	load_tree<max_out_targets> min_load;	// load + susload of each active target, by active_index
+	load_board<max_out_targets>* board = nullptr;	// shared with other engines, or null if balancing alone
+	note_pool_index held_head[128];	// oldest note held on each pitch, or -1
+	note_pool_index held_tail[128];	// newest note held on each pitch, or -1
+	note_index held_index;	// costs every note-off a hash find and erase, but keeps stacked pitches from being scanned
+	note_index id_index;	// held notes by noteId alone (pitch and channel 0), for note expressions
+	bool id_indexed = false;	// id_index is kept up to date; set by the first note expression
+	note_pool_index oldest = -1, newest = -1;	// ends of the note-on order list
+	note_pool_index evict_head[128];	// oldest note in each eviction bucket, or -1
+	note_pool_index evict_tail[128];	// newest note in each eviction bucket, or -1
+	uint64_t evict_nonempty[2] = {};	// kEvictQuietest: bitmap of non-empty velocity buckets
+	load_tree<max_out_targets> busiest;	// kEvictBusiest: held notes per target, inverted so the minimum is the busiest
+	note_in_record* note_pool = nullptr;
+	note_pool_index free_list = 0; // if free_list == pool_size then no free slots left in note_pool
+	note_pool_index pool_size = 0;
+	uint32_t held_count = 0;
+	uint32_t capacity = default_note_capacity;
+	uint64_t soslocked[2] = {};
+	uint64_t held_pitches[2] = {};	// bitmap of the pitches with held notes
+	uint32_t counter = 0; // for generating a uniform distribution of values non-randomly
+	uint32_t note_on_count = 0;
+	uint32_t eviction_count = 0;
+	pcg32 rng;
+	uint64_t seed = 0;
+	int32_t strategy = kMinLoad;
+	strategy_router router = nullptr;	// routing kernel for the strategy and channel count, or null if not remapping
+	bool load_aware = false;	// router balances by load
+	bool tree_live = false;	// router reads min_load, so update_load keeps it current
+	int32_t eviction = kEvictOldest;
+	int32_t load_model = kLoadCount;
+	tail_queue full_tails;	// tails in their first, full-cost half
+	tail_queue half_tails;	// tails in their second, half-cost half
+	int64_t sample_clock = 0;	// samples since the engine was created, at the start of the current block
+	int64_t now = 0;		// sample time of the event being processed
+	int64_t half_release = 0;	// samples per release stage, or 0 if tails are not counted
+	double sample_rate = default_sample_rate;
+	int32_t release_ms = 0;
+	int32_t feedback_gain = 0;
+	int32_t overload_percent = default_overload_percent;
+	uint8_t cost_table[num_cost_ranges][num_cost_bands];
+	zone_range zones[max_out_channels];
+	uint16_t key_owners[128];		// bitmap of the output channels whose zones contain each key
+	uint16_t velocity_owners[128];	// likewise for each velocity
+	int32_t zone_spill = 0;
+	int16_t out_channels = 4;
+	int16_t out_buses = 1;
+	int16_t roundrobin_channel = 0;	// index into the active targets, or into the weighted visiting order
+	uint8_t channel_weight[max_out_channels];
+	uint8_t weight_order[max_out_channels * max_channel_weight];	// active channels in smooth weighted round-robin order
+	int16_t weight_period = 0;	// length of weight_order
+	bool weighted = false;	// the active channels' weights differ
+	int16_t mpe_lower = 0, mpe_upper = 0;	// member channels per zone, as set
+	uint8_t mpe_role[16] = {};	// MpeRole of each input channel under the zones in effect
+	int16_t member_target[16];	// target of the newest note on each MPE member channel, or -1
+	uint16_t channel_value[16][kNumChannelMessages];	// latest value of each channel message, by input channel
+	uint16_t sent_value[max_out_targets][kNumChannelMessages];	// value of each message each target was last sent
+	uint8_t polyphony_cap[max_out_channels] = {};	// voice limit of each output channel, or 0
+	uint64_t full[2] = {};	// bitmap of the active targets (by active_index) at their voice limits
+	note_pool_index target_head[max_out_targets];	// oldest note held on each target, or -1 (only while capped)
+	note_pool_index target_tail[max_out_targets];	// newest note held on each target, or -1 (only while capped)
+	int32_t overflow = kOverflowSteal;
+	bool capped = false;	// some output channel has a voice limit
+	bool sustain_pedal_down = false;
+	bool sostenuto_pedal_down = false;
+	bool bypass = false;
+};
+
+static inline void set_target(spread_event& e, int16_t target)
+{
+	e.bus = (uint8_t)BUS_OF_TARGET(target);
+	e.channel = CHANNEL_OF_TARGET(target);
+}
+
+static inline void set_channel_message(spread_event& e, int32_t message, uint16_t value)
+{
+	e.type = kSpreadControlChange;
+	e.controlNumber = channel_message_cc[message];
+	e.value = (int8_t)(value & 0x7F);	// pitch bend: LSB, then MSB
+	e.value2 = (int8_t)(value >> 7);
+}
+
+static inline void emit(spread_output* out, const spread_event& e)
+{
+	if (out && (out->count < out->capacity))
+		out->events[out->count++] = e;
+}
+
+static inline uint32_t capacity_of_step(int32_t step)
+{
+	return min_note_capacity << step;
+}
+
+static inline int32_t step_of_capacity(uint32_t capacity)
+{
+	int32_t step = 0;
+	while ((step < num_capacity_steps - 1) && (capacity_of_step(step) < capacity))
+		++step;
+	return step;
+}
+
+// Index of the lowest set bit of a non-zero word
+static inline int32_t lowest_bit(uint64_t bits)
+{
+#if defined(_MSC_VER)
+	unsigned long i;
+	_BitScanForward64(&i, bits);
+	return (int32_t)i;
+#else
+	return __builtin_ctzll(bits);
+#endif
+}
+
+static inline int32_t count_bits(uint64_t bits)
+{
+#if defined(_MSC_VER)
+	return (int32_t)__popcnt64(bits);
+#else
+	return __builtin_popcountll(bits);
+#endif
+}
+
+static inline int32_t discretize(double value, int32_t max_value)
+{
+	const int32_t discrete = (int32_t)(value * (double)(max_value + 1));
+	return (discrete <= 0) ? 0 : (discrete >= max_value) ? max_value : discrete;
+}
@@ -10,6 +10,7 @@
 
 bool InitModule()
 {
+	spread_log_start();
 	LOG("InitModule called and exited.\n");
 	return true;
 }
@@ -17,6 +18,7 @@ bool InitModule()
 bool DeinitModule()
 {
 	LOG("DeinitModule called and exited.\n");
+	spread_log_stop();
 	return true;
 }
 
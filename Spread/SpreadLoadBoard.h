@@ -0,0 +1,36 @@
+#pragma once
+
+// Per-target load totals shared between engines, so that Spread instances feeding the same instruments (or the same
+// cores) can balance against each other's notes and not only their own.  Each engine adds the changes in its own load
+// on each target and reads back the totals; every access is a relaxed atomic, so no engine ever waits for another.
+// The table is plain lock-free counters, so it could equally be placed in memory shared between processes.
+
+#include <atomic>
+#include <cstdint>
+
+template <uint32_t targets>
+class load_board
+{
+public:
+	load_board(void)
+	{
+		for (uint32_t t = 0; t < targets; ++t)
+			load[t].store(0, std::memory_order_relaxed);
+	}
+
+	// Adds delta (which may be negative) to the target's total; wraps like unsigned arithmetic.
+	inline void add(uint32_t target, int32_t delta) { load[target].fetch_add((uint32_t)delta, std::memory_order_relaxed); }
+	inline uint32_t total(uint32_t target) const { return load[target].load(std::memory_order_relaxed); }
+
+	// The board every engine in this process shares
+	static load_board& process_board(void)
+	{
+		static load_board board;
+		return board;
+	}
+
+private:
+	static_assert(std::atomic<uint32_t>::is_always_lock_free, "load board counters must be lock-free");
+
+	std::atomic<uint32_t> load[targets];
+};
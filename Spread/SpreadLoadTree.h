@@ -0,0 +1,97 @@
+#pragma once
+
+// Tournament tree over the output targets' loads.  Each internal node holds the minimum load beneath it and how many
+// leaves share that minimum, so the minimum, the number of targets tied at it, and the r-th tied target (in target
+// order) are all available in O(log n) without scanning the targets.  Storage is for max_leaves targets, but the tree
+// is only as deep as the number of targets currently in use requires.
+
+#include <cstdint>
+
+template <uint32_t max_leaves>	// must be a power of two
+class load_tree
+{
+public:
+	static constexpr uint32_t excluded = UINT32_MAX;	// load of a target that must never be selected
+
+	load_tree(void) { resize(1); }
+
+	// Sets the number of targets and marks them all excluded.
+	void resize(uint32_t targets)
+	{
+		leaves = 1;
+		while ((leaves < targets) && (leaves < max_leaves))
+			leaves *= 2;
+		for (uint32_t i = leaves; i < 2 * leaves; ++i)
+		{
+			key[i] = excluded;
+			ties[i] = 1;
+		}
+		rebuild();
+	}
+
+	inline void update(uint32_t target, uint32_t load)
+	{
+		uint32_t i = target + leaves;
+		if (key[i] == load)
+			return;
+		key[i] = load;
+		for (i >>= 1; i > 0; i >>= 1)
+		{
+			if (!combine(i))
+				break;	// nothing above this node can change either
+		}
+	}
+
+	// Sets a target's load without updating the nodes above it, for changing many targets and then calling rebuild once.
+	inline void set(uint32_t target, uint32_t load) { key[target + leaves] = load; }
+
+	void rebuild(void)
+	{
+		for (uint32_t i = leaves - 1; i > 0; --i)
+			combine(i);
+	}
+
+	inline uint32_t load(uint32_t target) const { return key[target + leaves]; }
+	inline uint32_t min_load(void) const { return key[1]; }
+	inline uint32_t num_tied(void) const { return ties[1]; }
+
+	// Returns the r-th (0-based, in target order) of the num_tied() targets whose load equals min_load().
+	inline uint32_t select(uint32_t r) const
+	{
+		const uint32_t m = key[1];
+		uint32_t i = 1;
+		while (i < leaves)
+		{
+			const uint32_t left = 2 * i;
+			if ((key[left] == m) && (r < ties[left]))
+				i = left;
+			else
+			{
+				if (key[left] == m)
+					r -= ties[left];
+				i = left + 1;
+			}
+		}
+		return i - leaves;
+	}
+
+private:
+	static_assert((max_leaves & (max_leaves - 1)) == 0, "load_tree size must be a power of two");
+
+	// Recomputes node i from its children and returns whether it changed.
+	inline bool combine(uint32_t i)
+	{
+		const uint32_t l = key[2 * i], r = key[2 * i + 1];
+		const uint32_t m = (l < r) ? l : r;
+		const uint16_t t = (uint16_t)(((l == m) ? ties[2 * i] : 0) + ((r == m) ? ties[2 * i + 1] : 0));
+		if ((key[i] == m) && (ties[i] == t))
+			return false;
+		key[i] = m;
+		ties[i] = t;
+		return true;
+	}
+
+	uint32_t leaves;
+	uint32_t key[2 * max_leaves];
+	uint16_t ties[2 * max_leaves];
+};
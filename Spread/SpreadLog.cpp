@@ -0,0 +1,268 @@
+#include "SpreadLog.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+
+std::atomic<int32_t> log_level{ kLogOff };
+
+namespace {
+
+static_assert((log_ring_size & (log_ring_size - 1)) == 0, "log ring size must be a power of two");
+
+// Bounded multi-producer, single-consumer ring (Vyukov).  Each cell's sequence number says whether it is free for the
+// producer claiming position pos (sequence == pos) or holds a record for the consumer (sequence == pos + 1).
+typedef struct {
+	std::atomic<uint64_t> sequence;
+	log_record record;
+} log_cell;
+
+class log_ring
+{
+public:
+	log_ring(void)
+	{
+		for (uint64_t i = 0; i < log_ring_size; ++i)
+			cells[i].sequence.store(i, std::memory_order_relaxed);
+	}
+
+	bool push(const log_record& r)
+	{
+		uint64_t pos = write_pos.load(std::memory_order_relaxed);
+		for (;;)
+		{
+			log_cell& c = cells[pos & (log_ring_size - 1)];
+			const int64_t diff = (int64_t)(c.sequence.load(std::memory_order_acquire) - pos);
+			if (diff == 0)
+			{
+				if (write_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					c.record = r;
+					c.sequence.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (diff < 0)
+				return false;	// full
+			else
+				pos = write_pos.load(std::memory_order_relaxed);
+		}
+	}
+
+	// Consumer only
+	bool pop(log_record& r)
+	{
+		log_cell& c = cells[read_pos & (log_ring_size - 1)];
+		if (c.sequence.load(std::memory_order_acquire) != read_pos + 1)
+			return false;
+		r = c.record;
+		c.sequence.store(read_pos + log_ring_size, std::memory_order_release);
+		++read_pos;
+		return true;
+	}
+
+private:
+	log_cell cells[log_ring_size];
+	alignas(64) std::atomic<uint64_t> write_pos{ 0 };
+	alignas(64) uint64_t read_pos = 0;
+};
+
+constexpr uint32_t log_batch_bytes = 64 * 1024;
+constexpr auto log_flush_period = std::chrono::milliseconds(50);
+
+log_ring ring;
+std::atomic<uint64_t> dropped{ 0 };
+const auto log_epoch = std::chrono::steady_clock::now();
+
+std::mutex control_mutex;	// serializes start, stop, and level changes (never taken by producers)
+std::mutex wake_mutex;
+std::condition_variable wake;
+std::thread writer;
+bool stopping = false;
+
+std::string log_path(void)
+{
+	if (const char* path = getenv("SPREAD_LOG_FILE"))
+		return path;
+	const char* dir = getenv("TEMP");
+	if (!dir)
+		dir = getenv("TMPDIR");
+#ifdef _WIN32
+	return std::string(dir ? dir : ".") + "\\SpreadVST.log";
+#else
+	return std::string(dir ? dir : "/tmp") + "/SpreadVST.log";
+#endif
+}
+
+// Formats one conversion of the record's next argument.  spec holds the flags, width, and precision (without '%',
+// length modifiers, or the conversion character).
+int format_arg(char* out, size_t room, const std::string& spec, char conversion, uint8_t type, const log_arg& a)
+{
+	std::string f = "%" + spec;
+	switch (conversion)
+	{
+	case 'd': case 'i':
+	case 'o': case 'u': case 'x': case 'X':
+		f += "ll";
+		f += conversion;
+		if ((conversion == 'd') || (conversion == 'i'))
+			return snprintf(out, room, f.c_str(), (long long)((type == kLogArgDouble) ? (int64_t)a.d : a.i));
+		return snprintf(out, room, f.c_str(), (unsigned long long)((type == kLogArgDouble) ? (uint64_t)a.d : a.u));
+	case 'c':
+		f += 'c';
+		return snprintf(out, room, f.c_str(), (int)a.i);
+	case 's':
+		f += 's';
+		return snprintf(out, room, f.c_str(), (type == kLogArgString) && a.p ? (const char*)a.p : "(null)");
+	case 'p':
+		f += 'p';
+		return snprintf(out, room, f.c_str(), a.p);
+	default:	// floating point
+		f += conversion;
+		return snprintf(out, room, f.c_str(), (type == kLogArgDouble) ? a.d :
+			((type == kLogArgUnsigned) ? (double)a.u : (double)a.i));
+	}
+}
+
+// Appends the formatted record to out and returns the number of characters written (at most room - 1).
+size_t format_record(char* out, size_t room, const log_record& r)
+{
+	size_t n = 0;
+	auto advance = [&](int written) {
+		if (written > 0)
+			n += ((size_t)written < room - n) ? (size_t)written : (room - n - 1);
+	};
+
+	advance(snprintf(out, room, "[%12.6f] ", (double)r.time_ns * 1e-9));
+	uint32_t next = 0;
+	for (const char* p = r.format; *p && (n + 1 < room); ++p)
+	{
+		if (*p != '%')
+		{
+			out[n++] = *p;
+			continue;
+		}
+		if (p[1] == '%')
+		{
+			out[n++] = '%';
+			++p;
+			continue;
+		}
+		std::string spec;
+		++p;
+		while (*p && strchr("-+ #0123456789.", *p))
+			spec += *p++;
+		while (*p && strchr("hlLqjzt", *p))
+			++p;
+		if (!*p)
+			break;
+		if (next >= r.count)
+			advance(snprintf(out + n, room - n, "<missing>"));
+		else
+		{
+			advance(format_arg(out + n, room - n, spec, *p, r.type[next], r.arg[next]));
+			++next;
+		}
+	}
+	out[n] = '\0';
+	return n;
+}
+
+void write_loop(void)
+{
+	static char batch[log_batch_bytes];
+	FILE* f = fopen(log_path().c_str(), "a");
+	uint64_t reported_drops = 0;
+	bool done = false;
+	while (!done)
+	{
+		{
+			std::unique_lock<std::mutex> lock(wake_mutex);
+			wake.wait_for(lock, log_flush_period, [] { return stopping; });
+			done = stopping;
+		}
+
+		size_t used = 0;
+		log_record r;
+		while (ring.pop(r))
+		{
+			if (log_batch_bytes - used < 1024)
+			{
+				if (f)
+					fwrite(batch, 1, used, f);
+				used = 0;
+			}
+			used += format_record(batch + used, log_batch_bytes - used, r);
+		}
+		if (log_batch_bytes - used < 1024)
+		{
+			if (f)
+				fwrite(batch, 1, used, f);
+			used = 0;
+		}
+		const uint64_t d = dropped.load(std::memory_order_relaxed);
+		if (d != reported_drops)
+		{
+			used += (size_t)snprintf(batch + used, log_batch_bytes - used,
+				"(%llu log records dropped)\n", (unsigned long long)(d - reported_drops));
+			reported_drops = d;
+		}
+		if (f && used)
+		{
+			fwrite(batch, 1, used, f);
+			fflush(f);
+		}
+	}
+	if (f)
+		fclose(f);
+}
+
+void start_writer(void)
+{
+	if (writer.joinable() || (log_level.load(std::memory_order_relaxed) <= kLogOff))
+		return;
+	stopping = false;
+	writer = std::thread(write_loop);
+}
+
+}	// namespace
+
+void spread_log_start(void)
+{
+	std::lock_guard<std::mutex> lock(control_mutex);
+	if (const char* level = getenv("SPREAD_LOG_LEVEL"))
+		log_level.store(atoi(level), std::memory_order_relaxed);
+	start_writer();
+}
+
+void spread_log_stop(void)
+{
+	std::lock_guard<std::mutex> lock(control_mutex);
+	if (!writer.joinable())
+		return;
+	{
+		std::lock_guard<std::mutex> wake_lock(wake_mutex);
+		stopping = true;
+	}
+	wake.notify_one();
+	writer.join();
+}
+
+void spread_log_set_level(int32_t level)
+{
+	std::lock_guard<std::mutex> lock(control_mutex);
+	log_level.store(level, std::memory_order_relaxed);
+	start_writer();
+}
+
+void spread_log_submit(log_record& r)
+{
+	r.time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - log_epoch).count();
+	if (!ring.push(r))
+		dropped.fetch_add(1, std::memory_order_relaxed);
+}
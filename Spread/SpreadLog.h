@@ -0,0 +1,122 @@
+#pragma once
+
+// Asynchronous diagnostic log.  A logging call only checks the runtime verbosity and, if the message is wanted, copies
+// its format string pointer and arguments into a fixed-size record in a lock-free ring; it never formats, allocates,
+// blocks, or touches a file.  A background thread drains the ring, formats the records, and appends them to the log
+// file in batches.  When the ring is full, records are dropped and counted rather than waited for.
+//
+// The format string identifies the record, so it must be a string literal (or otherwise outlive the log), and so must
+// any %s argument.  Integer conversions are formatted from 64-bit values, so length modifiers in the format are
+// ignored.  '*' widths and precisions are not supported.
+//
+// The log file is $SPREAD_LOG_FILE, or SpreadVST.log in the temporary directory.  The starting verbosity is
+// $SPREAD_LOG_LEVEL (0 = off, the default, through 3 = trace).
+
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+
+enum LogLevel {
+	kLogOff = 0,
+	kLogError,
+	kLogInfo,
+	kLogTrace
+};
+
+// Message from the controller asking the processor to change the verbosity (the Log Level parameter), as an integer
+// attribute
+constexpr const char* log_level_message_id = "SpreadLogLevel";
+constexpr const char* log_level_attribute = "level";
+
+constexpr uint32_t max_log_args = 6;
+constexpr uint32_t log_ring_size = 2048;	// records; must be a power of two
+
+enum LogArgType : uint8_t {
+	kLogArgInt = 0,
+	kLogArgUnsigned,
+	kLogArgDouble,
+	kLogArgString,
+	kLogArgPointer
+};
+
+typedef union {
+	int64_t i;
+	uint64_t u;
+	double d;
+	const void* p;
+} log_arg;
+
+typedef struct {
+	const char* format;
+	int64_t time_ns;		// steady-clock time of the call
+	uint8_t level;
+	uint8_t count;			// number of arguments
+	uint8_t type[max_log_args];
+	log_arg arg[max_log_args];
+} log_record;
+
+extern std::atomic<int32_t> log_level;
+
+// Starts the writer thread if the current verbosity needs it.  Called when the module is loaded; not real-time safe.
+void spread_log_start(void);
+// Drains whatever is still queued and stops the writer thread.  Called when the module is unloaded.
+void spread_log_stop(void);
+// Changes the verbosity at run time, starting the writer thread if it is not yet running.  Not real-time safe.
+void spread_log_set_level(int32_t level);
+// Timestamps and queues a record, or counts it as dropped if the ring is full.  Lock-free; never blocks the caller.
+void spread_log_submit(log_record& r);
+
+template <typename T>
+inline void log_pack(log_record& r, T value)
+{
+	log_arg& a = r.arg[r.count];
+	if constexpr (std::is_floating_point_v<T>)
+	{
+		r.type[r.count] = kLogArgDouble;
+		a.d = (double)value;
+	}
+	else if constexpr (std::is_same_v<std::decay_t<T>, const char*> || std::is_same_v<std::decay_t<T>, char*>)
+	{
+		r.type[r.count] = kLogArgString;
+		a.p = value;
+	}
+	else if constexpr (std::is_pointer_v<T>)
+	{
+		r.type[r.count] = kLogArgPointer;
+		a.p = (const void*)value;
+	}
+	else if constexpr (std::is_signed_v<T>)
+	{
+		r.type[r.count] = kLogArgInt;
+		a.i = (int64_t)value;
+	}
+	else
+	{
+		static_assert(std::is_integral_v<T> || std::is_enum_v<T>, "unsupported log argument type");
+		r.type[r.count] = kLogArgUnsigned;
+		a.u = (uint64_t)value;
+	}
+	++r.count;
+}
+
+template <typename... Args>
+inline void spread_log(int32_t level, const char* format, Args... args)
+{
+	static_assert(sizeof...(Args) <= max_log_args, "too many log arguments");
+	if (level > log_level.load(std::memory_order_relaxed))
+		return;
+	log_record r;
+	r.format = format;
+	r.level = (uint8_t)level;
+	r.count = 0;
+	(log_pack(r, args), ...);
+	spread_log_submit(r);
+}
+
+#ifdef LOGGING
+#	define LOG(...) spread_log(kLogTrace, __VA_ARGS__)
+#	define LOG_ERROR(...) spread_log(kLogError, __VA_ARGS__)
+#else
+#	define LOG(...) 0
+#	define LOG_ERROR(...) 0
+#endif
@@ -0,0 +1,120 @@
+#pragma once
+
+// Hash index from a held note's (pitch, input channel, noteId) key to the chain of note_pool entries that share that
+// key.  The table is allocated up front by allocate, never during lookups or updates.  Uses linear probing with
+// backward-shift deletion, so lookups never have to skip over tombstones no matter how long the plug-in runs.
+
+#include <cstdint>
+#include <cstdlib>
+
+typedef struct {
+	int32_t noteId;
+	uint16_t pitch_channel;	// (pitch << 4) | input channel, or note_index::empty
+	int16_t head, tail;		// oldest and newest note_pool entries with this key
+} note_index_entry;
+
+class note_index
+{
+public:
+	static constexpr uint16_t empty = 0xFFFF;
+
+	~note_index(void) { free(table); }
+
+	// Replaces the table with an empty one that comfortably holds the given number of keys.  Not real-time safe.
+	bool allocate(uint32_t keys)
+	{
+		uint32_t capacity = 16;
+		while (capacity < 2 * keys)
+			capacity *= 2;
+		note_index_entry* const new_table = (note_index_entry*)malloc(capacity * sizeof(*new_table));
+		if (!new_table)
+			return false;
+		free(table);
+		table = new_table;
+		mask = capacity - 1;
+		clear();
+		return true;
+	}
+
+	void swap(note_index& other)
+	{
+		note_index_entry* const t = table;
+		const uint32_t m = mask;
+		table = other.table;
+		mask = other.mask;
+		other.table = t;
+		other.mask = m;
+	}
+
+	void clear(void)
+	{
+		for (uint32_t i = 0; table && (i <= mask); ++i)
+			table[i].pitch_channel = empty;
+	}
+
+	// Returns the entry for the given key, or nullptr if no held note has it.
+	inline note_index_entry* find(int16_t pitch, int16_t in_channel, int32_t noteId)
+	{
+		const uint16_t pc = key(pitch, in_channel);
+		for (uint32_t i = home(pc, noteId); ; i = (i + 1) & mask)
+		{
+			note_index_entry& e = table[i];
+			if ((e.pitch_channel == pc) && (e.noteId == noteId))
+				return &e;
+			if (e.pitch_channel == empty)
+				return nullptr;
+		}
+	}
+
+	// Returns the entry for the given key, creating an empty one (head = tail = -1) if necessary.  The caller must
+	// never hold more keys than the table was allocated for, so there is always room.
+	inline note_index_entry* insert(int16_t pitch, int16_t in_channel, int32_t noteId)
+	{
+		const uint16_t pc = key(pitch, in_channel);
+		for (uint32_t i = home(pc, noteId); ; i = (i + 1) & mask)
+		{
+			note_index_entry& e = table[i];
+			if ((e.pitch_channel == pc) && (e.noteId == noteId))
+				return &e;
+			if (e.pitch_channel == empty)
+			{
+				e.pitch_channel = pc;
+				e.noteId = noteId;
+				e.head = e.tail = -1;
+				return &e;
+			}
+		}
+	}
+
+	// Removes an entry.  Other entries may move, so pointers previously returned by find or insert become invalid.
+	inline void erase(note_index_entry* e)
+	{
+		uint32_t i = (uint32_t)(e - table);
+		for (uint32_t j = (i + 1) & mask; table[j].pitch_channel != empty; j = (j + 1) & mask)
+		{
+			// shift entry j back into the hole unless its home slot lies cyclically within (i, j]
+			const uint32_t h = home(table[j].pitch_channel, table[j].noteId);
+			if (((j - h) & mask) >= ((j - i) & mask))
+			{
+				table[i] = table[j];
+				i = j;
+			}
+		}
+		table[i].pitch_channel = empty;
+	}
+
+private:
+	static inline uint16_t key(int16_t pitch, int16_t in_channel)
+	{
+		return (uint16_t)((pitch << 4) | in_channel);
+	}
+
+	inline uint32_t home(uint16_t pc, int32_t noteId) const
+	{
+		const uint32_t h = ((uint32_t)noteId * 0x9E3779B1u) ^ ((uint32_t)pc * 0x85EBCA77u);
+		return (h ^ (h >> 15)) & mask;
+	}
+
+	note_index_entry* table = nullptr;
+	uint32_t mask = 0;	// table size - 1
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+// Small, fast, per-instance pseudo-random generator (PCG32: O'Neill, "PCG: A Family of Simple Fast Space-Efficient
+// Statistically Good Algorithms for Random Number Generation").  Each engine owns one, so instances never reseed or
+// contend with each other the way they would through the C runtime's global rand().
+
+#include <cstdint>
+
+class pcg32
+{
+public:
+	static constexpr uint64_t increment = 1442695040888963407ULL;
+
+	void seed(uint64_t s)
+	{
+		state = 0;
+		next();
+		state += s;
+		next();
+	}
+
+	inline uint32_t next(void)
+	{
+		const uint64_t old = state;
+		state = old * 6364136223846793005ULL + increment;
+		const uint32_t xorshifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+		const uint32_t rot = (uint32_t)(old >> 59);
+		return (xorshifted >> rot) | (xorshifted << ((0u - rot) & 31));
+	}
+
+	// Uniform in [0, n) for n > 0, without modulo bias (Lemire's multiply-and-reject method).
+	inline uint32_t below(uint32_t n)
+	{
+		uint64_t m = (uint64_t)next() * n;
+		uint32_t low = (uint32_t)m;
+		if (low < n)
+		{
+			const uint32_t threshold = (0u - n) % n;
+			while (low < threshold)
+			{
+				m = (uint64_t)next() * n;
+				low = (uint32_t)m;
+			}
+		}
+		return (uint32_t)(m >> 32);
+	}
+
+	uint64_t get_state(void) const { return state; }
+	void set_state(uint64_t s) { state = s; }
+
+private:
+	uint64_t state = 0;
+};
@@ -0,0 +1,235 @@
+#pragma once
+
+// Note distribution strategies as policy classes.  Each policy's route<oc> picks the output target of a note-on, and
+// is instantiated for the common output channel counts (oc = 2, 4, 8, 16) so that indexing the active targets compiles
+// to shifts and masks, with oc = 0 reading the channel count at run time.  The engine looks up the kernel for its
+// strategy and channel count whenever either changes (see SpreadEngine::select_router), so note_on makes a single
+// indirect call rather than re-examining the strategy for every note.
+//
+// Each kernel also comes in a capped form, used while some output channel has a voice limit, that never returns a
+// target at its limit.  It returns -1 if every target is full, leaving the note to the engine's overflow policy.
+//
+// To add a strategy, derive a policy from strategy_policy, add its Strategy value, and add a row for it to
+// strategy_table below.  Policies reach the engine only through strategy_policy's accessors.
+
+#include "SpreadEngine.h"
+
+struct strategy_policy
+{
+	static constexpr bool reads_tree = false;	// routes from the engine's min_load tree, which is only kept up to date if so
+
+protected:
+	template <int16_t oc>
+	static inline int16_t channels(const SpreadEngine& e) { return oc ? oc : e.out_channels; }
+
+	template <int16_t oc>
+	static inline int16_t num_active(const SpreadEngine& e) { return channels<oc>(e) * e.out_buses; }
+
+	template <int16_t oc>
+	static inline int16_t nth_active(const SpreadEngine& e, int16_t n)
+	{
+		const uint16_t c = (uint16_t)channels<oc>(e);
+		return TARGET_OF((uint16_t)n / c, (uint16_t)n % c);
+	}
+
+	template <int16_t oc>
+	static inline int16_t active_index(const SpreadEngine& e, int16_t target)
+	{
+		return BUS_OF_TARGET(target) * channels<oc>(e) + CHANNEL_OF_TARGET(target);
+	}
+
+	// Active targets below their voice limits, counted and indexed in active order (capped kernels only)
+	template <int16_t oc>
+	static inline int16_t num_open(const SpreadEngine& e)
+	{
+		return (int16_t)(num_active<oc>(e) - count_bits(e.full[0]) - count_bits(e.full[1]));
+	}
+
+	template <int16_t oc>
+	static inline int16_t nth_open(const SpreadEngine& e, int16_t r)
+	{
+		const int16_t n = num_active<oc>(e);
+		for (int16_t w = 0; w < 2; ++w)
+		{
+			const int16_t in_word = n - 64 * w;
+			const uint64_t active = (in_word >= 64) ? ~0ULL : (in_word > 0) ? ((1ULL << in_word) - 1) : 0;
+			uint64_t open = ~e.full[w] & active;
+			const int32_t count = count_bits(open);
+			if (r < count)
+			{
+				for (; r > 0; --r)
+					open &= open - 1;
+				return nth_active<oc>(e, (int16_t)(64 * w + lowest_bit(open)));
+			}
+			r = (int16_t)(r - count);
+		}
+		return -1;
+	}
+
+	static inline bool is_full(const SpreadEngine& e, int16_t target) { return e.is_full(target); }
+
+	// The active targets in weighted visiting order: each bus's channels in the engine's weight_order, bus by bus
+	static inline bool weighted(const SpreadEngine& e) { return e.weighted; }
+	static inline int16_t num_visits(const SpreadEngine& e) { return (int16_t)(e.weight_period * e.out_buses); }
+	static inline int16_t nth_visit(const SpreadEngine& e, int16_t i)
+	{
+		return TARGET_OF((uint16_t)i / (uint16_t)e.weight_period, e.weight_order[(uint16_t)i % (uint16_t)e.weight_period]);
+	}
+
+	static inline uint32_t load_key(const SpreadEngine& e, int16_t target) { return e.load_key(target); }
+	static inline const load_tree<max_out_targets>& min_load(const SpreadEngine& e) { return e.min_load; }
+	static inline uint32_t next_counter(SpreadEngine& e) { return ++e.counter; }
+	static inline pcg32& rng(SpreadEngine& e) { return e.rng; }
+	static inline int16_t& roundrobin_index(SpreadEngine& e) { return e.roundrobin_channel; }
+	static inline int16_t zoned_target(SpreadEngine& e, int16_t pitch, uint8_t velocity) { return e.zoned_target(pitch, velocity); }
+
+	static inline uint8_t velocity_of(const spread_event& evt)
+	{
+		const float velocity = evt.velocity * 127.F + 0.5F;
+		return (velocity <= 0.F) ? 0 : (velocity >= 127.F) ? 127 : (uint8_t)velocity;
+	}
+};
+
+struct min_load_strategy : strategy_policy
+{
+	static constexpr bool load_aware = true;
+	static constexpr bool reads_tree = true;
+
+	template <int16_t oc, bool capped>
+	static int16_t route(SpreadEngine& e, const spread_event&)
+	{
+		// rotate through the targets tied for the lowest load; full targets are excluded from the tree
+		const load_tree<max_out_targets>& tree = min_load(e);
+		if (capped && (tree.min_load() == tree.excluded))
+			return -1;
+		return nth_active<oc>(e, (int16_t)tree.select(next_counter(e) % tree.num_tied()));
+	}
+};
+
+struct round_robin_strategy : strategy_policy
+{
+	static constexpr bool load_aware = false;
+
+	template <int16_t oc, bool capped>
+	static int16_t route(SpreadEngine& e, const spread_event&)
+	{
+		int16_t& i = roundrobin_index(e);
+		const bool by_weight = weighted(e);
+		const int16_t n = by_weight ? num_visits(e) : num_active<oc>(e);
+		for (int16_t tries = 0; tries < n; ++tries)
+		{
+			if (i >= n)
+				i = 0;
+			const int16_t target = by_weight ? nth_visit(e, i++) : nth_active<oc>(e, i++);
+			if (!capped || !is_full(e, target))
+				return target;
+		}
+		return -1;
+	}
+};
+
+struct random_strategy : strategy_policy
+{
+	static constexpr bool load_aware = false;
+
+	template <int16_t oc, bool capped>
+	static int16_t route(SpreadEngine& e, const spread_event&)
+	{
+		if (weighted(e))
+		{
+			if (capped && (num_open<oc>(e) <= 0))
+				return -1;
+			// a random visit; if that target is full, the next open one in visiting order
+			const int16_t n = num_visits(e);
+			int16_t i = (int16_t)rng(e).below(n);
+			int16_t target = nth_visit(e, i);
+			while (capped && is_full(e, target))
+			{
+				i = (int16_t)((i + 1 < n) ? (i + 1) : 0);
+				target = nth_visit(e, i);
+			}
+			return target;
+		}
+		if (!capped)
+			return nth_active<oc>(e, (int16_t)rng(e).below(num_active<oc>(e)));
+		const int16_t n = num_open<oc>(e);
+		return (n > 0) ? nth_open<oc>(e, (int16_t)rng(e).below(n)) : -1;
+	}
+};
+
+struct two_choices_strategy : strategy_policy
+{
+	static constexpr bool load_aware = true;
+
+	template <int16_t oc, bool capped>
+	static int16_t route(SpreadEngine& e, const spread_event&)
+	{
+		// two distinct random targets; keep the less loaded
+		const int16_t n = capped ? num_open<oc>(e) : num_active<oc>(e);
+		if (capped && (n <= 0))
+			return -1;
+		const int16_t first = (int16_t)rng(e).below(n);
+		int16_t target = capped ? nth_open<oc>(e, first) : nth_active<oc>(e, first);
+		if (n > 1)
+		{
+			int16_t other = (int16_t)rng(e).below(n - 1);
+			if (other >= first)
+				++other;
+			other = capped ? nth_open<oc>(e, other) : nth_active<oc>(e, other);
+			if (load_key(e, other) < load_key(e, target))
+				target = other;
+		}
+		return target;
+	}
+};
+
+struct zoned_strategy : strategy_policy
+{
+	static constexpr bool load_aware = true;
+
+	template <int16_t oc, bool capped>
+	static int16_t route(SpreadEngine& e, const spread_event& evt)
+	{
+		return zoned_target(e, evt.pitch, velocity_of(evt));
+	}
+};
+
+// Kernels by channel count: index 0 is the generic one, then one per specialized count.
+constexpr int32_t num_channel_kernels = 5;
+
+static inline int32_t channel_kernel(int16_t out_channels)
+{
+	switch (out_channels)
+	{
+	case 2: return 1;
+	case 4: return 2;
+	case 8: return 3;
+	case 16: return 4;
+	default: return 0;
+	}
+}
+
+typedef struct {
+	strategy_router route[2][num_channel_kernels];	// uncapped, then capped
+	bool load_aware;	// routes by load, so chords are worth ordering by cost
+	bool reads_tree;	// routes from min_load
+} strategy_kernels;
+
+template <class Policy>
+constexpr strategy_kernels kernels_of(void)
+{
+	return { { { &Policy::template route<0, false>, &Policy::template route<2, false>, &Policy::template route<4, false>,
+		&Policy::template route<8, false>, &Policy::template route<16, false> },
+		{ &Policy::template route<0, true>, &Policy::template route<2, true>, &Policy::template route<4, true>,
+		&Policy::template route<8, true>, &Policy::template route<16, true> } }, Policy::load_aware, Policy::reads_tree };
+}
+
+// In Strategy order
+constexpr strategy_kernels strategy_table[] = {
+	kernels_of<min_load_strategy>(),
+	kernels_of<round_robin_strategy>(),
+	kernels_of<random_strategy>(),
+	kernels_of<two_choices_strategy>(),
+	kernels_of<zoned_strategy>()
+};
+static_assert(sizeof(strategy_table) / sizeof(*strategy_table) == kNumStrategies, "every strategy needs kernels");
@@ -0,0 +1,66 @@
+#pragma once
+
+// Fixed-capacity FIFO of release tails still counted against their output targets' loads.  Every tail is given the
+// same lifetime when it is pushed, so pushing in time order keeps the queue sorted by deadline and expiring tails
+// only ever has to look at the front.  The storage is allocated up front by allocate, never by push.
+
+#include <cstdint>
+#include <cstdlib>
+
+typedef struct {
+	int64_t deadline;	// sample time at which this stage of the tail ends
+	int16_t target;
+	uint8_t cost;		// load still counted for this tail
+} tail_entry;
+
+class tail_queue
+{
+public:
+	~tail_queue(void) { free(entries); }
+
+	// Replaces the storage with an empty queue of the given capacity.  Not real-time safe.
+	bool allocate(uint32_t capacity)
+	{
+		tail_entry* new_entries = nullptr;
+		if (capacity > 0)
+		{
+			new_entries = (tail_entry*)malloc(capacity * sizeof(*new_entries));
+			if (!new_entries)
+				return false;
+		}
+		free(entries);
+		entries = new_entries;
+		size = capacity;
+		clear();
+		return true;
+	}
+
+	void clear(void) { head = count = 0; }
+
+	inline bool empty(void) const { return count == 0; }
+	inline bool full(void) const { return count >= size; }
+	inline uint32_t capacity(void) const { return size; }
+	inline const tail_entry& front(void) const { return entries[head]; }
+
+	inline void pop(void)
+	{
+		head = (head + 1 == size) ? 0 : (head + 1);
+		--count;
+	}
+
+	// The caller must make room first if the queue is full.
+	inline void push(const tail_entry& e)
+	{
+		uint32_t i = head + count;
+		if (i >= size)
+			i -= size;
+		entries[i] = e;
+		++count;
+	}
+
+private:
+	tail_entry* entries = nullptr;
+	uint32_t size = 0;
+	uint32_t head = 0;
+	uint32_t count = 0;
+};
@@ -0,0 +1,72 @@
+#pragma once
+
+// Runtime statistics the processor publishes for meters.  The audio thread fills a snapshot every telemetry period
+// and pushes it into a wait-free single-producer, single-consumer ring, from which the message thread takes the newest
+// when the controller asks for it.  Neither side ever blocks or allocates.
+
+#include <atomic>
+#include <cstdint>
+
+#include "SpreadEngine.h"
+
+constexpr double telemetry_rate = 30.;	// snapshots per second
+constexpr uint32_t telemetry_ring_size = 4;
+
+// Full-scale values of the read-only telemetry parameters
+constexpr double max_meter_rate = 1000.;		// notes or evictions per second
+constexpr double max_meter_process_us = 10000.;
+
+// Messages between the controller and the processor: the controller asks, the processor replies with the newest
+// snapshot as a binary attribute.
+constexpr const char* telemetry_request_id = "SpreadTelemetryRequest";
+constexpr const char* telemetry_reply_id = "SpreadTelemetry";
+constexpr const char* telemetry_attribute = "snapshot";
+
+typedef struct {
+	uint32_t load[max_out_targets];		// held-note load of each target, in load units
+	uint32_t susload[max_out_targets];	// sustained-note load of each target
+	uint32_t tail[max_out_targets];		// release-tail load of each target (0 unless Release Time is set)
+	uint32_t held_notes;
+	uint32_t capacity;		// note pool capacity
+	uint32_t note_ons;		// routed since the plug-in was created
+	uint32_t evictions;		// notes released early because the pool was full, likewise
+	int16_t active_targets;
+	float imbalance;		// 1 - mean / max of the active targets' total loads; 0 = perfectly even
+	float notes_per_second;
+	float evictions_per_second;
+	float worst_process_us;	// longest process() call during the period
+} spread_telemetry;
+
+template <typename T, uint32_t size>	// size must be a power of two
+class spsc_ring
+{
+public:
+	// Producer only.  Returns false, dropping the item, if the consumer has fallen behind.
+	bool push(const T& item)
+	{
+		const uint32_t tail = write_index.load(std::memory_order_relaxed);
+		if (tail - read_index.load(std::memory_order_acquire) >= size)
+			return false;
+		items[tail & (size - 1)] = item;
+		write_index.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer only.  Returns false if the ring is empty.
+	bool pop(T& item)
+	{
+		const uint32_t head = read_index.load(std::memory_order_relaxed);
+		if (head == write_index.load(std::memory_order_acquire))
+			return false;
+		item = items[head & (size - 1)];
+		read_index.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	static_assert((size & (size - 1)) == 0, "spsc_ring size must be a power of two");
+
+	T items[size];
+	std::atomic<uint32_t> write_index{ 0 };
+	std::atomic<uint32_t> read_index{ 0 };
+};
@@ -0,0 +1,301 @@
+#include "SpreadTrace.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+constexpr auto trace_flush_period = std::chrono::milliseconds(20);
+
+std::string trace_capture_path(void)
+{
+	static std::atomic<uint32_t> sequence{ 0 };
+	const char* dir = getenv("SPREAD_TRACE_DIR");
+	if (!dir || !*dir)
+		return std::string();
+	const long long ms = (long long)std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+	char name[64];
+	snprintf(name, sizeof(name), "spread-%lld-%u.sptrace", ms, (unsigned)sequence.fetch_add(1));
+#ifdef _WIN32
+	return std::string(dir) + "\\" + name;
+#else
+	return std::string(dir) + "/" + name;
+#endif
+}
+
+bool trace_writer::open(const char* path, uint32_t ring_bytes)
+{
+	close();
+	if ((ring_bytes == 0) || (ring_bytes & (ring_bytes - 1)))
+		return false;
+	file = fopen(path, "wb");
+	if (!file)
+		return false;
+	trace_file_header h;
+	memcpy(h.magic, trace_magic, sizeof(h.magic));
+	h.version = trace_version;
+	ring = (unsigned char*)malloc(ring_bytes);
+	if (!ring || (fwrite(&h, sizeof(h), 1, file) != 1))
+	{
+		free(ring);
+		ring = nullptr;
+		fclose(file);
+		file = nullptr;
+		return false;
+	}
+	ring_size = ring_bytes;
+	write_pos.store(0, std::memory_order_relaxed);
+	read_pos.store(0, std::memory_order_relaxed);
+	dropped = 0;
+	started = false;
+	stopping = false;
+	writer = std::thread(&trace_writer::write_loop, this);
+	return true;
+}
+
+void trace_writer::close(void)
+{
+	if (!ring)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(wake_mutex);
+		stopping = true;
+	}
+	wake.notify_one();
+	writer.join();
+	fclose(file);
+	file = nullptr;
+	free(ring);
+	ring = nullptr;
+	ring_size = 0;
+}
+
+bool trace_writer::put(uint16_t kind, const void* payload, uint16_t size)
+{
+	const uint64_t head = write_pos.load(std::memory_order_relaxed);
+	const uint32_t need = (uint32_t)sizeof(trace_record) + size;
+	if (ring_size - (uint32_t)(head - read_pos.load(std::memory_order_acquire)) < need)
+		return false;
+
+	const trace_record r = { kind, size };
+	uint64_t at = head;
+	auto copy = [&](const void* src, uint32_t n) {
+		const uint32_t i = (uint32_t)at & (ring_size - 1);
+		const uint32_t first = (n < ring_size - i) ? n : (ring_size - i);
+		memcpy(ring + i, src, first);
+		memcpy(ring, (const unsigned char*)src + first, n - first);
+		at += n;
+	};
+	copy(&r, sizeof(r));
+	copy(payload, size);
+	write_pos.store(at, std::memory_order_release);
+	return true;
+}
+
+void trace_writer::write(uint16_t kind, const void* payload, uint16_t size)
+{
+	if (!ring || (!started && (kind != kTraceSnapshot)))
+		return;
+	if (dropped)
+	{
+		// the reader must know where the stream broke before it sees anything after it
+		if (!put(kTraceGap, &dropped, sizeof(dropped)))
+		{
+			++dropped;
+			return;
+		}
+		dropped = 0;
+	}
+	if (put(kind, payload, size))
+		started = true;
+	else
+		++dropped;
+}
+
+void trace_writer::drain(void)
+{
+	const uint64_t head = write_pos.load(std::memory_order_acquire);
+	const uint64_t tail = read_pos.load(std::memory_order_relaxed);
+	if (head == tail)
+		return;
+	const uint32_t i = (uint32_t)tail & (ring_size - 1);
+	const uint32_t n = (uint32_t)(head - tail);
+	const uint32_t first = (n < ring_size - i) ? n : (ring_size - i);
+	fwrite(ring + i, 1, first, file);
+	fwrite(ring, 1, n - first, file);
+	read_pos.store(head, std::memory_order_release);
+}
+
+void trace_writer::write_loop(void)
+{
+	bool done = false;
+	while (!done)
+	{
+		{
+			std::unique_lock<std::mutex> lock(wake_mutex);
+			wake.wait_for(lock, trace_flush_period, [this] { return stopping; });
+			done = stopping;
+		}
+		drain();
+	}
+	fflush(file);
+}
+
+void dump_trace_event(FILE* f, uint32_t block, const spread_event& e)
+{
+	fprintf(f, "%u %d bus=%u ch=%d type=%u pitch=%d vel=%.6f id=%d cc=%u v=%d/%d tag=%d\n", block, e.sampleOffset,
+		(unsigned)e.bus, e.channel, (unsigned)e.type, e.pitch, e.velocity, e.noteId, (unsigned)e.controlNumber,
+		e.value, e.value2, e.tag);
+}
+
+bool replay_trace(const unsigned char* data, size_t size, FILE* dump, replay_stats& stats)
+{
+	std::unique_ptr<SpreadEngine> engine(new SpreadEngine());
+	std::vector<spread_event> out_storage(engine->max_output_events());
+	spread_output out = { out_storage.data(), (uint32_t)out_storage.size(), 0 };
+	uint64_t digest = trace_digest_basis;
+	uint32_t outputs = 0;
+	bool verifying = true;
+
+	auto flush = [&](void) {
+		digest = trace_digest(digest, out.events, out.count);
+		outputs += out.count;
+		if (dump)
+		{
+			for (uint32_t i = 0; i < out.count; ++i)
+				dump_trace_event(dump, stats.blocks + 1, out.events[i]);
+		}
+		out.count = 0;
+	};
+
+	size_t pos = sizeof(trace_file_header);
+	while (pos + sizeof(trace_record) <= size)
+	{
+		trace_record r;
+		memcpy(&r, data + pos, sizeof(r));
+		pos += sizeof(r);
+		if (pos + r.size > size)
+			break;	// cut short, e.g. by a crash while capturing
+		const unsigned char* payload = data + pos;
+		pos += r.size;
+
+		const auto started = std::chrono::steady_clock::now();
+		switch (r.kind)
+		{
+		case kTraceSnapshot:
+		{
+			trace_snapshot s;
+			if (r.size != sizeof(s))
+			{
+				stats.malformed = true;
+				return false;
+			}
+			memcpy(&s, payload, sizeof(s));
+			if (!apply_trace_snapshot(*engine, s))
+				return false;
+			if (out_storage.size() < engine->max_output_events())
+			{
+				out_storage.resize(engine->max_output_events());
+				out.events = out_storage.data();
+				out.capacity = (uint32_t)out_storage.size();
+			}
+		}
+		break;
+
+		case kTraceParameter:
+		{
+			trace_parameter p;
+			if (r.size != sizeof(p))
+			{
+				stats.malformed = true;
+				return false;
+			}
+			memcpy(&p, payload, sizeof(p));
+			engine->set_parameter(p.id, p.value, p.sampleOffset, p.ppq, &out);
+			flush();
+			++stats.parameters;
+		}
+		break;
+
+		case kTraceEvent:
+		{
+			trace_event t;
+			if (r.size != sizeof(t))
+			{
+				stats.malformed = true;
+				return false;
+			}
+			memcpy(&t, payload, sizeof(t));
+			spread_event e = from_trace_event(t);
+			engine->process_event(e, &out);
+			flush();
+			++stats.events;
+		}
+		break;
+
+		case kTraceChord:
+		{
+			uint16_t n = 0;
+			if (r.size >= sizeof(n))
+				memcpy(&n, payload, sizeof(n));
+			if ((r.size < sizeof(n)) || (n > max_chord_notes) || (r.size != sizeof(n) + n * sizeof(trace_event)))
+			{
+				stats.malformed = true;
+				return false;
+			}
+			spread_event chord[max_chord_notes];
+			for (uint16_t i = 0; i < n; ++i)
+			{
+				trace_event t;
+				memcpy(&t, payload + sizeof(n) + i * sizeof(t), sizeof(t));
+				chord[i] = from_trace_event(t);
+			}
+			engine->chord_on(&out, chord, n);
+			flush();
+			stats.events += n;
+		}
+		break;
+
+		case kTraceBlock:
+		{
+			trace_block b;
+			if (r.size != sizeof(b))
+			{
+				stats.malformed = true;
+				return false;
+			}
+			memcpy(&b, payload, sizeof(b));
+			engine->advance_clock(b.samples);
+			++stats.blocks;
+			stats.outputs += outputs;
+			if (verifying)
+			{
+				if ((b.outputs != outputs) || (b.digest != digest))
+				{
+					stats.mismatched_block = stats.blocks;
+					return false;
+				}
+				++stats.verified_blocks;
+			}
+			digest = trace_digest_basis;
+			outputs = 0;
+		}
+		break;
+
+		case kTraceGap:
+		{
+			uint64_t n = 0;
+			memcpy(&n, payload, (r.size < sizeof(n)) ? r.size : sizeof(n));
+			stats.dropped += n;
+			verifying = false;
+		}
+		break;
+
+		default:
+			break;	// from a newer version; skip it
+		}
+		stats.ns += (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started).count();
+	}
+	return true;
+}
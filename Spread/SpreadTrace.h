@@ -0,0 +1,311 @@
+#pragma once
+
+// Binary trace of everything the processor feeds the engine, for replaying live sessions offline.  A trace is a
+// trace_file_header followed by records, each a trace_record header and a payload of the given size, in native
+// (little-endian) byte order.  It opens with a snapshot of the engine's settings and distribution sequence, and then
+// has every parameter point, input event, and note-on chord in the order the engine saw them, with a record at the
+// end of each block carrying a digest of the block's output so that a replay can be checked against it.
+//
+// The audio thread only copies records into a preallocated ring; a background thread drains it to the file.  If the
+// ring fills, records are dropped, and a gap record says how many, past which a replay can no longer be exact.
+//
+// A replay starts from a new engine, which cannot recreate notes that were already sounding, so a trace only begins,
+// with its first snapshot, once the engine is idle (SpreadEngine::is_idle); until then nothing is recorded.  A replay
+// is also only exact if the instance was not sharing its load with others (see SpreadLoadBoard.h), whose notes are
+// not in the trace.
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "SpreadEngine.h"
+
+constexpr char trace_magic[8] = { 'S', 'P', 'R', 'D', 'T', 'R', 'C', 'E' };
+constexpr uint32_t trace_version = 4;
+constexpr uint32_t default_trace_ring_bytes = 4 << 20;	// must be a power of two
+
+enum TraceRecordKind : uint16_t
+{
+	kTraceSnapshot = 0,	// trace_snapshot: engine settings and sequence (on activation, and after a state load)
+	kTraceParameter,	// trace_parameter
+	kTraceEvent,		// trace_event: an input event routed on its own
+	kTraceChord,		// uint16_t count, then that many trace_events routed as one chord
+	kTraceBlock,		// trace_block: end of a processing block
+	kTraceGap			// uint64_t: records dropped because the ring was full
+};
+
+#pragma pack(push, 1)
+typedef struct {
+	char magic[8];
+	uint32_t version;
+} trace_file_header;
+
+typedef struct {
+	uint16_t kind;
+	uint16_t size;	// payload bytes that follow
+} trace_record;
+
+typedef struct {
+	double ppqPosition;
+	int32_t sampleOffset;
+	int32_t tag;
+	int32_t noteId;
+	float velocity;
+	int16_t channel;
+	int16_t pitch;
+	uint8_t bus;
+	uint8_t type;
+	uint8_t controlNumber;
+	int8_t value, value2;
+} trace_event;
+
+typedef struct {
+	uint32_t id;
+	int32_t sampleOffset;
+	double value;
+	double ppq;
+} trace_parameter;
+
+typedef struct {
+	int32_t samples;	// 0 if routing failed and the block was abandoned
+	uint32_t outputs;	// events the engine emitted during the block
+	uint64_t digest;	// trace_digest of those events, in order
+} trace_block;
+
+typedef struct {
+	uint8_t activated;	// the pool was (re)allocated just before this snapshot
+	int16_t out_channels, out_buses;
+	int32_t strategy, eviction, load_model;
+	uint32_t capacity;
+	uint8_t costs[num_cost_ranges][num_cost_bands];
+	int32_t feedback_gain, overload_percent, release_ms;
+	double sample_rate;
+	int16_t mpe_lower, mpe_upper;
+	zone_range zones[max_out_channels];
+	int32_t zone_spill;
+	uint8_t polyphony_caps[max_out_channels];
+	int32_t overflow;
+	uint8_t channel_weights[max_out_channels];
+	uint8_t bypass, sustain, sostenuto;
+	float measured[max_out_targets];
+	uint8_t drained[max_out_targets];
+	uint64_t seed;
+	uint64_t random_state;
+	uint32_t tie_counter;
+	int16_t roundrobin;
+	uint16_t channel_values[16][kNumChannelMessages];
+	uint16_t sent_values[max_out_targets][kNumChannelMessages];
+	int16_t member_targets[16];
+} trace_snapshot;
+#pragma pack(pop)
+
+static inline trace_event to_trace_event(const spread_event& e)
+{
+	trace_event t;
+	t.ppqPosition = e.ppqPosition;
+	t.sampleOffset = e.sampleOffset;
+	t.tag = e.tag;
+	t.noteId = e.noteId;
+	t.velocity = e.velocity;
+	t.channel = e.channel;
+	t.pitch = e.pitch;
+	t.bus = e.bus;
+	t.type = e.type;
+	t.controlNumber = e.controlNumber;
+	t.value = e.value;
+	t.value2 = e.value2;
+	return t;
+}
+
+static inline spread_event from_trace_event(const trace_event& t)
+{
+	spread_event e = {};
+	e.ppqPosition = t.ppqPosition;
+	e.sampleOffset = t.sampleOffset;
+	e.tag = t.tag;
+	e.noteId = t.noteId;
+	e.velocity = t.velocity;
+	e.channel = t.channel;
+	e.pitch = t.pitch;
+	e.bus = t.bus;
+	e.type = t.type;
+	e.controlNumber = t.controlNumber;
+	e.value = t.value;
+	e.value2 = t.value2;
+	return e;
+}
+
+// FNV-1a over the events' fields
+constexpr uint64_t trace_digest_basis = 14695981039346656037ULL;
+
+static inline uint64_t trace_digest(uint64_t h, const spread_event* events, uint32_t count)
+{
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		const trace_event t = to_trace_event(events[i]);
+		const unsigned char* p = (const unsigned char*)&t;
+		for (size_t j = 0; j < sizeof(t); ++j)
+			h = (h ^ p[j]) * 1099511628211ULL;
+	}
+	return h;
+}
+
+static inline trace_snapshot take_trace_snapshot(const SpreadEngine& engine, bool activated)
+{
+	trace_snapshot s = {};
+	s.activated = activated ? 1 : 0;
+	s.out_channels = engine.get_outchannels();
+	s.out_buses = engine.get_outbuses();
+	s.strategy = engine.get_strategy();
+	s.eviction = engine.get_eviction();
+	s.load_model = engine.get_load_model();
+	s.capacity = engine.get_capacity();
+	for (int32_t r = 0; r < num_cost_ranges; ++r)
+	{
+		for (int32_t b = 0; b < num_cost_bands; ++b)
+			s.costs[r][b] = engine.get_cost(r, b);
+	}
+	s.feedback_gain = engine.get_feedback_gain();
+	s.overload_percent = engine.get_overload_percent();
+	s.release_ms = engine.get_release_ms();
+	s.sample_rate = engine.get_sample_rate();
+	s.mpe_lower = engine.get_mpe_lower();
+	s.mpe_upper = engine.get_mpe_upper();
+	for (int16_t c = 0; c < max_out_channels; ++c)
+		s.zones[c] = engine.get_zone(c);
+	s.zone_spill = engine.get_zone_spill();
+	for (int16_t c = 0; c < max_out_channels; ++c)
+		s.polyphony_caps[c] = engine.get_polyphony_cap(c);
+	s.overflow = engine.get_overflow();
+	for (int16_t c = 0; c < max_out_channels; ++c)
+		s.channel_weights[c] = engine.get_channel_weight(c);
+	s.bypass = engine.is_bypassed() ? 1 : 0;
+	s.sustain = engine.is_sustain_pedal_down() ? 1 : 0;
+	s.sostenuto = engine.is_sostenuto_pedal_down() ? 1 : 0;
+	for (int16_t t = 0; t < max_out_targets; ++t)
+	{
+		s.measured[t] = engine.get_measured_load(t);
+		s.drained[t] = engine.is_drained(t) ? 1 : 0;
+	}
+	s.seed = engine.get_seed();
+	engine.get_sequence(s.random_state, s.tie_counter, s.roundrobin);
+	engine.get_channel_messages(s.channel_values, s.sent_values, s.member_targets);
+	return s;
+}
+
+// Puts an engine into the snapshot's state, allocating its pool if the snapshot was taken on activation.  Returns
+// false if out of memory.  Not real-time safe.
+static inline bool apply_trace_snapshot(SpreadEngine& engine, const trace_snapshot& s)
+{
+	engine.set_outchannels(nullptr, s.out_channels, 0);
+	engine.set_outbuses(nullptr, s.out_buses, 0);
+	engine.set_strategy(s.strategy);
+	engine.set_eviction(s.eviction);
+	engine.set_capacity(s.capacity);
+	engine.set_load_model(s.load_model);
+	for (int32_t r = 0; r < num_cost_ranges; ++r)
+	{
+		for (int32_t b = 0; b < num_cost_bands; ++b)
+			engine.set_cost(r, b, s.costs[r][b]);
+	}
+	engine.set_feedback_gain(s.feedback_gain);
+	engine.set_overload_percent(s.overload_percent);
+	engine.set_sample_rate(s.sample_rate);
+	engine.set_release_ms(s.release_ms);
+	engine.set_mpe_zones(s.mpe_lower, s.mpe_upper);
+	for (int16_t c = 0; c < max_out_channels; ++c)
+		engine.set_zone(c, s.zones[c]);
+	engine.set_zone_spill(s.zone_spill);
+	for (int16_t c = 0; c < max_out_channels; ++c)
+		engine.set_polyphony_cap(c, s.polyphony_caps[c]);
+	engine.set_overflow(s.overflow);
+	for (int16_t c = 0; c < max_out_channels; ++c)
+		engine.set_channel_weight(c, s.channel_weights[c]);
+	engine.set_parameter(kBypass, s.bypass ? 1. : 0., 0, 0., nullptr);
+	if ((s.sustain != 0) != engine.is_sustain_pedal_down())
+		engine.set_parameter(kSustain, s.sustain ? 1. : 0., 0, 0., nullptr);
+	if ((s.sostenuto != 0) != engine.is_sostenuto_pedal_down())
+		engine.set_parameter(kSostenuto, s.sostenuto ? 1. : 0., 0, 0., nullptr);
+	for (int16_t t = 0; t < max_out_targets; ++t)
+	{
+		engine.set_drained(t, s.drained[t] != 0);
+		engine.set_measured_load(t, s.measured[t]);
+	}
+	engine.set_seed(s.seed);
+	if (s.activated && !engine.allocate_pool())
+		return false;
+	engine.set_sequence(s.random_state, s.tie_counter, s.roundrobin);
+	engine.set_channel_messages(s.channel_values, s.sent_values, s.member_targets);
+	return true;
+}
+
+static inline bool is_trace(const unsigned char* data, size_t size)
+{
+	trace_file_header h;
+	if (size < sizeof(h))
+		return false;
+	memcpy(&h, data, sizeof(h));
+	return !memcmp(h.magic, trace_magic, sizeof(h.magic)) && (h.version == trace_version);
+}
+
+typedef struct {
+	uint32_t blocks;
+	uint32_t events;
+	uint32_t parameters;
+	uint32_t outputs;
+	uint32_t mismatched_block;	// 1-based; 0 if every verified block matched
+	uint32_t verified_blocks;
+	uint64_t dropped;			// records the capture lost (nothing after the first gap is verified)
+	bool malformed;
+	double ns;					// time spent in the engine
+} replay_stats;
+
+// Feeds a trace (the whole file, header included, checked by is_trace) through a new engine, checking every block's
+// output against the digest recorded with it, and printing the output to dump if it is not null.  Returns false at the
+// first block whose output differs, at a malformed record, or if out of memory; stats says which.
+bool replay_trace(const unsigned char* data, size_t size, FILE* dump, replay_stats& stats);
+// Prints an output event as replay_trace dumps it: one line, starting with its 1-based block number
+void dump_trace_event(FILE* f, uint32_t block, const spread_event& e);
+
+// Path for a new trace if capture is enabled: a uniquely named file in $SPREAD_TRACE_DIR.  Empty if it is not set.
+std::string trace_capture_path(void);
+
+class trace_writer
+{
+public:
+	~trace_writer(void) { close(); }
+
+	// Creates the file and ring and starts the writer thread.  Not real-time safe.
+	bool open(const char* path, uint32_t ring_bytes = default_trace_ring_bytes);
+	// Stops the writer thread after it has drained the ring, and closes the file.  Not real-time safe.
+	void close(void);
+	bool is_open(void) const { return ring != nullptr; }
+	// Whether the trace has begun with its first snapshot; records written before that are discarded.
+	bool is_recording(void) const { return started; }
+
+	// Queues a record, or counts it as dropped if the ring has no room.  Wait-free; one producer thread at a time.
+	void write(uint16_t kind, const void* payload, uint16_t size);
+
+private:
+	bool put(uint16_t kind, const void* payload, uint16_t size);
+	void drain(void);
+	void write_loop(void);
+
+	unsigned char* ring = nullptr;
+	uint32_t ring_size = 0;
+	std::atomic<uint64_t> write_pos{ 0 };	// bytes ever queued (producer)
+	std::atomic<uint64_t> read_pos{ 0 };	// bytes ever written out (writer thread)
+	uint64_t dropped = 0;	// records dropped since the last gap record (producer only)
+	bool started = false;	// the first snapshot has been queued (producer only)
+	FILE* file = nullptr;
+	std::thread writer;
+	std::mutex wake_mutex;
+	std::condition_variable wake;
+	bool stopping = false;
+};
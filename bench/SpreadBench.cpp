@@ -0,0 +1,673 @@
+// Microbenchmarks for the per-event routing hot path of SpreadEngine.
+//
+// Each profile drives the engine with a reproducible stress workload and reports the median cost, in nanoseconds
+// per input event, of note_on, note_off, polypressure, and release_all.  Results are written in the same format as
+// bench/baseline.txt so that a run can be compared against the checked-in baseline:
+//
+//     SpreadBench                               print results
+//     SpreadBench --compare bench/baseline.txt  print results and fail if any is slower than the baseline allows
+//     SpreadBench --tolerance 0.5               allowed slowdown relative to the baseline (default 0.25 = 25%)
+//     SpreadBench --trials 15                   number of timed repetitions per measurement (default 9)
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "SpreadEngine.h"
+
+typedef std::chrono::steady_clock bench_clock;
+
+static spread_event out_storage[max_events_per_call];
+static spread_output out = { out_storage, max_events_per_call, 0 };
+
+struct held_note {
+	int16_t channel;
+	int16_t pitch;
+	int32_t noteId;
+};
+
+struct bench_result {
+	std::string profile, op;
+	double ns_per_event;
+};
+
+static std::vector<bench_result> results;
+static int trials = 9;
+
+// Deterministic pseudo-random sequence so that every run sees the same workload.
+static uint32_t lcg_state = 1;
+static uint32_t lcg(void)
+{
+	lcg_state = lcg_state * 1664525u + 1013904223u;
+	return lcg_state >> 8;
+}
+
+static spread_event make_event(uint8_t type, const held_note& n, float velocity)
+{
+	spread_event e = {};
+	e.type = type;
+	e.tag = 0;
+	e.channel = n.channel;
+	e.pitch = n.pitch;
+	e.noteId = n.noteId;
+	e.velocity = velocity;
+	return e;
+}
+
+static void send(SpreadEngine& engine, uint8_t type, const held_note& n, float velocity = 0.8F)
+{
+	spread_event e = make_event(type, n, velocity);
+	engine.process_event(e, &out);
+	out.count = 0;
+}
+
+static void set_param(SpreadEngine& engine, uint32_t id, double value)
+{
+	engine.set_parameter(id, value, 0, 0., &out);
+	out.count = 0;
+}
+
+// Normalized parameter value selecting the given discrete step
+static double step_value(int32_t value, int32_t max_value)
+{
+	return ((double)value + 0.5) / (double)(max_value + 1);
+}
+
+static void configure(SpreadEngine& engine, int32_t strategy, int16_t channels)
+{
+	set_param(engine, kStrategy, step_value(strategy, kNumStrategies - 1));
+	set_param(engine, kOutChannels, step_value(channels, max_out_channels));
+}
+
+static int32_t next_note_id = 0;
+
+static held_note random_note(int16_t pitch = -1)
+{
+	held_note n;
+	n.channel = (int16_t)(lcg() % 16);
+	n.pitch = (pitch >= 0) ? pitch : (int16_t)(lcg() % 128);
+	n.noteId = next_note_id++;
+	return n;
+}
+
+static void fill(SpreadEngine& engine, std::vector<held_note>& held, size_t count, int16_t pitch = -1)
+{
+	while (held.size() < count)
+	{
+		held.push_back(random_note(pitch));
+		send(engine, kSpreadNoteOn, held.back());
+	}
+}
+
+static void release(SpreadEngine& engine, std::vector<held_note>& held)
+{
+	engine.release_all(&out, 0, 0., kSpreadCtrlAllNotesOff);
+	out.count = 0;
+	held.clear();
+}
+
+// Runs setup (untimed) and body (timed) for the configured number of trials and records the median cost per event.
+template <typename Setup, typename Body>
+static void measure(const char* profile, const char* op, Setup setup, Body body)
+{
+	std::vector<double> samples;
+	for (int t = 0; t < trials; ++t)
+	{
+		size_t events = 0;
+		double ns = 0.;
+		// repeat until the timed region is long enough for the clock resolution to be irrelevant
+		while (ns < 2e6)
+		{
+			setup();
+			const bench_clock::time_point start = bench_clock::now();
+			events += body();
+			ns += (double)std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - start).count();
+		}
+		samples.push_back(ns / (double)events);
+	}
+	std::sort(samples.begin(), samples.end());
+	results.push_back({ profile, op, samples[samples.size() / 2] });
+}
+
+// Notes are added and removed in batches around a nearly full pool of default_note_capacity.
+static void profile_held512(void)
+{
+	const size_t batch = 64;
+	SpreadEngine engine;
+	std::vector<held_note> held;
+	configure(engine, kMinLoad, 4);
+	fill(engine, held, default_note_capacity - batch);
+	std::vector<held_note> extra;
+
+	measure("held512", "note_on",
+		[&] {
+			for (const held_note& n : extra)
+				send(engine, kSpreadNoteOff, n);
+			extra.clear();
+			for (size_t i = 0; i < batch; ++i)
+				extra.push_back(random_note());
+		},
+		[&] {
+			for (const held_note& n : extra)
+				send(engine, kSpreadNoteOn, n);
+			return extra.size();
+		});
+
+	measure("held512", "note_off",
+		[&] {
+			for (const held_note& n : extra)
+				send(engine, kSpreadNoteOff, n);
+			extra.clear();
+			for (size_t i = 0; i < batch; ++i)
+			{
+				extra.push_back(random_note());
+				send(engine, kSpreadNoteOn, extra.back());
+			}
+		},
+		[&] {
+			for (const held_note& n : extra)
+				send(engine, kSpreadNoteOff, n);
+			const size_t n = extra.size();
+			extra.clear();
+			return n;
+		});
+
+	fill(engine, held, default_note_capacity);
+	measure("held512", "polypressure",
+		[&] {},
+		[&] {
+			for (size_t i = 0; i < held.size(); i += 7)
+				send(engine, kSpreadPolyPressure, held[i], 0.5F);
+			return (held.size() + 6) / 7;
+		});
+
+	// every note-on at capacity evicts a held note
+	const char* const evict_ops[kNumEvictions] = { "note_on_evict", "evict_quietest", "evict_busiest", "evict_stacked" };
+	for (int32_t policy = 0; policy < kNumEvictions; ++policy)
+	{
+		set_param(engine, kEviction, step_value(policy, kNumEvictions - 1));
+		measure("held512", evict_ops[policy],
+			[&] {
+				release(engine, held);
+				fill(engine, held, default_note_capacity);
+			},
+			[&] {
+				for (size_t i = 0; i < batch; ++i)
+					send(engine, kSpreadNoteOn, random_note(), (float)(lcg() % 128) / 127.F);
+				return batch;
+			});
+	}
+	set_param(engine, kEviction, step_value(kEvictOldest, kNumEvictions - 1));
+
+	measure("held512", "release_all",
+		[&] {
+			release(engine, held);
+			fill(engine, held, default_note_capacity);
+		},
+		[&] {
+			engine.release_all(&out, 0, 0., kSpreadCtrlAllNotesOff);
+			out.count = 0;
+			const size_t n = held.size();
+			held.clear();
+			return n;
+		});
+}
+
+// Many simultaneous notes stacked on a single pitch, as from drum rolls, retriggered pads, or hosts that send noteId -1.
+static void profile_chord_cluster(void)
+{
+	const size_t stack = 128;
+	SpreadEngine engine;
+	std::vector<held_note> held;
+	configure(engine, kMinLoad, 8);
+
+	measure("chord_cluster", "note_on",
+		[&] { release(engine, held); for (size_t i = 0; i < stack; ++i) held.push_back(random_note(60)); },
+		[&] {
+			for (const held_note& n : held)
+				send(engine, kSpreadNoteOn, n);
+			return held.size();
+		});
+
+	measure("chord_cluster", "note_off",
+		[&] { release(engine, held); fill(engine, held, stack, 60); },
+		[&] {
+			// newest first, so that each lookup walks the whole stack
+			for (size_t i = held.size(); i-- > 0; )
+				send(engine, kSpreadNoteOff, held[i]);
+			const size_t n = held.size();
+			held.clear();
+			return n;
+		});
+
+	measure("chord_cluster", "polypressure",
+		[&] { if (held.size() != stack) { release(engine, held); fill(engine, held, stack, 60); } },
+		[&] {
+			for (size_t i = held.size(); i-- > 0; )
+				send(engine, kSpreadPolyPressure, held[i], 0.5F);
+			return held.size();
+		});
+
+	measure("chord_cluster", "release_all",
+		[&] { release(engine, held); fill(engine, held, stack, 60); },
+		[&] {
+			engine.release_all(&out, 0, 0., kSpreadCtrlAllNotesOff);
+			out.count = 0;
+			const size_t n = held.size();
+			held.clear();
+			return n;
+		});
+}
+
+// Rapid sustain pedal presses and releases interleaved with note traffic
+static void profile_sustain_storm(void)
+{
+	SpreadEngine engine;
+	std::vector<held_note> held;
+	configure(engine, kMinLoad, 16);
+	fill(engine, held, 96);
+
+	measure("sustain_storm", "mixed",
+		[&] {},
+		[&] {
+			size_t events = 0;
+			for (int round = 0; round < 16; ++round)
+			{
+				set_param(engine, kSustain, 1.);
+				for (int i = 0; i < 8; ++i)
+				{
+					const size_t victim = lcg() % held.size();
+					send(engine, kSpreadNoteOff, held[victim]);
+					held[victim] = random_note();
+					send(engine, kSpreadNoteOn, held[victim]);
+				}
+				set_param(engine, kSustain, 0.);
+				events += 2 + 16;
+			}
+			return events;
+		});
+
+	set_param(engine, kSustain, 1.);
+	measure("sustain_storm", "note_off",
+		[&] { release(engine, held); fill(engine, held, 96); },
+		[&] {
+			for (const held_note& n : held)
+				send(engine, kSpreadNoteOff, n);
+			const size_t n = held.size();
+			held.clear();
+			return n;
+		});
+
+	measure("sustain_storm", "pedal",
+		[&] { if (held.size() != 96) { release(engine, held); fill(engine, held, 96); } },
+		[&] {
+			for (int i = 0; i < 64; ++i)
+			{
+				set_param(engine, kSustain, 0.);
+				set_param(engine, kSustain, 1.);
+				set_param(engine, kSostenuto, 1.);
+				set_param(engine, kSostenuto, 0.);
+			}
+			return (size_t)256;
+		});
+}
+
+// Min-Load selection across all 16 output channels
+static void profile_minload16(void)
+{
+	SpreadEngine engine;
+	std::vector<held_note> held;
+	configure(engine, kMinLoad, 16);
+	fill(engine, held, 64);
+
+	measure("minload16", "note_on",
+		[&] {
+			for (size_t i = 64; i < held.size(); ++i)
+				send(engine, kSpreadNoteOff, held[i]);
+			held.resize(64);
+		},
+		[&] {
+			for (int i = 0; i < 64; ++i)
+			{
+				held.push_back(random_note());
+				send(engine, kSpreadNoteOn, held.back());
+			}
+			return (size_t)64;
+		});
+
+	// the same, balancing per-note costs from the cost table instead of note counts
+	set_param(engine, kLoadModel, step_value(kLoadWeighted, kNumLoadModels - 1));
+	measure("minload16", "weighted_on",
+		[&] {
+			for (size_t i = 64; i < held.size(); ++i)
+				send(engine, kSpreadNoteOff, held[i]);
+			held.resize(64);
+		},
+		[&] {
+			for (int i = 0; i < 64; ++i)
+			{
+				held.push_back(random_note());
+				send(engine, kSpreadNoteOn, held.back(), (float)(lcg() % 128) / 127.F);
+			}
+			return (size_t)64;
+		});
+
+	// the same notes arriving as eight-note chords, each assigned as one batch
+	measure("minload16", "weighted_chord",
+		[&] {
+			for (size_t i = 64; i < held.size(); ++i)
+				send(engine, kSpreadNoteOff, held[i]);
+			held.resize(64);
+		},
+		[&] {
+			spread_event chord[8];
+			for (int c = 0; c < 8; ++c)
+			{
+				for (int i = 0; i < 8; ++i)
+				{
+					held.push_back(random_note());
+					chord[i] = make_event(kSpreadNoteOn, held.back(), (float)(lcg() % 128) / 127.F);
+				}
+				engine.chord_on(&out, chord, 8);
+				out.count = 0;
+			}
+			return (size_t)64;
+		});
+	for (size_t i = 64; i < held.size(); ++i)
+		send(engine, kSpreadNoteOff, held[i]);
+	held.resize(64);
+	set_param(engine, kLoadModel, step_value(kLoadCount, kNumLoadModels - 1));
+
+	// the same, publishing every load change to a load board shared with another instance
+	{
+		load_board<max_out_targets> board;
+		SpreadEngine other;
+		configure(other, kMinLoad, 16);
+		other.set_load_board(&board);
+		engine.set_load_board(&board);
+		measure("minload16", "shared_on",
+			[&] {
+				for (size_t i = 64; i < held.size(); ++i)
+					send(engine, kSpreadNoteOff, held[i]);
+				held.resize(64);
+				engine.advance_clock(64);
+			},
+			[&] {
+				for (int i = 0; i < 64; ++i)
+				{
+					held.push_back(random_note());
+					send(engine, kSpreadNoteOn, held.back());
+				}
+				return (size_t)64;
+			});
+		engine.set_load_board(nullptr);
+	}
+	for (size_t i = 64; i < held.size(); ++i)
+		send(engine, kSpreadNoteOff, held[i]);
+	held.resize(64);
+
+	// the same, with every other channel given twice the capacity weight
+	for (int16_t c = 0; c < max_out_channels; c += 2)
+		engine.set_channel_weight(c, 2);
+	measure("minload16", "capacity_on",
+		[&] {
+			for (size_t i = 64; i < held.size(); ++i)
+				send(engine, kSpreadNoteOff, held[i]);
+			held.resize(64);
+		},
+		[&] {
+			for (int i = 0; i < 64; ++i)
+			{
+				held.push_back(random_note());
+				send(engine, kSpreadNoteOn, held.back());
+			}
+			return (size_t)64;
+		});
+	for (size_t i = 64; i < held.size(); ++i)
+		send(engine, kSpreadNoteOff, held[i]);
+	held.resize(64);
+	for (int16_t c = 0; c < max_out_channels; c += 2)
+		engine.set_channel_weight(c, 1);
+
+	measure("minload16", "note_off",
+		[&] { fill(engine, held, 128); },
+		[&] {
+			for (size_t i = 64; i < held.size(); ++i)
+				send(engine, kSpreadNoteOff, held[i]);
+			const size_t n = held.size() - 64;
+			held.resize(64);
+			return n;
+		});
+
+	measure("minload16", "polypressure",
+		[&] {},
+		[&] {
+			for (const held_note& n : held)
+				send(engine, kSpreadPolyPressure, n, 0.5F);
+			return held.size();
+		});
+}
+
+// Min-Load selection across 128 targets (8 buses of 16 channels)
+static void profile_minload128(void)
+{
+	SpreadEngine engine;
+	std::vector<held_note> held;
+	configure(engine, kMinLoad, 16);
+	engine.set_outbuses(&out, max_out_buses, 0);
+	out.count = 0;
+	fill(engine, held, 256);
+
+	measure("minload128", "note_on",
+		[&] {
+			for (size_t i = 256; i < held.size(); ++i)
+				send(engine, kSpreadNoteOff, held[i]);
+			held.resize(256);
+		},
+		[&] {
+			for (int i = 0; i < 64; ++i)
+			{
+				held.push_back(random_note());
+				send(engine, kSpreadNoteOn, held.back());
+			}
+			return (size_t)64;
+		});
+
+	// the same spread with the constant-cost two-choices strategy
+	set_param(engine, kStrategy, step_value(kTwoChoices, kNumStrategies - 1));
+	measure("minload128", "two_choices",
+		[&] {
+			for (size_t i = 256; i < held.size(); ++i)
+				send(engine, kSpreadNoteOff, held[i]);
+			held.resize(256);
+		},
+		[&] {
+			for (int i = 0; i < 64; ++i)
+			{
+				held.push_back(random_note());
+				send(engine, kSpreadNoteOn, held.back());
+			}
+			return (size_t)64;
+		});
+
+	// and with each channel owning an eight-key zone, spilling over at four notes per target
+	set_param(engine, kStrategy, step_value(kZoned, kNumStrategies - 1));
+	for (int16_t c = 0; c < max_out_channels; ++c)
+		engine.set_zone(c, { (uint8_t)(8 * c), (uint8_t)(8 * c + 7), 0, 127 });
+	engine.set_zone_spill(4);
+	measure("minload128", "zoned",
+		[&] {
+			for (size_t i = 256; i < held.size(); ++i)
+				send(engine, kSpreadNoteOff, held[i]);
+			held.resize(256);
+		},
+		[&] {
+			for (int i = 0; i < 64; ++i)
+			{
+				held.push_back(random_note());
+				send(engine, kSpreadNoteOn, held.back());
+			}
+			return (size_t)64;
+		});
+}
+
+// Short notes with release tails counted for 2 seconds at 48 kHz, so that tails are continually queued and expired
+static void profile_tails16(void)
+{
+	SpreadEngine engine;
+	configure(engine, kMinLoad, 16);
+	engine.set_sample_rate(48000.);
+	set_param(engine, kReleaseTime, 2000. / (double)max_release_ms);
+
+	measure("tails16", "note_on_off",
+		[&] {},
+		[&] {
+			for (int i = 0; i < 64; ++i)
+			{
+				const held_note n = random_note();
+				send(engine, kSpreadNoteOn, n);
+				send(engine, kSpreadNoteOff, n);
+				engine.advance_clock(256);
+			}
+			return (size_t)128;
+		});
+}
+
+// An orchestral-template sized pool of 8192 notes, nearly full, with notes added and removed in batches
+static void profile_held8192(void)
+{
+	const size_t batch = 256;
+	const uint32_t capacity = 8192;
+	SpreadEngine engine;
+	std::vector<held_note> held, extra;
+	set_param(engine, kCapacity, step_value(step_of_capacity(capacity), num_capacity_steps - 1));
+	engine.allocate_pool();
+	configure(engine, kMinLoad, 16);
+	fill(engine, held, capacity - batch);
+
+	measure("held8192", "note_on",
+		[&] {
+			for (const held_note& n : extra)
+				send(engine, kSpreadNoteOff, n);
+			extra.clear();
+			for (size_t i = 0; i < batch; ++i)
+				extra.push_back(random_note());
+		},
+		[&] {
+			for (const held_note& n : extra)
+				send(engine, kSpreadNoteOn, n);
+			return extra.size();
+		});
+
+	measure("held8192", "note_off",
+		[&] {
+			for (const held_note& n : extra)
+				send(engine, kSpreadNoteOff, n);
+			extra.clear();
+			for (size_t i = 0; i < batch; ++i)
+			{
+				extra.push_back(random_note());
+				send(engine, kSpreadNoteOn, extra.back());
+			}
+		},
+		[&] {
+			for (const held_note& n : extra)
+				send(engine, kSpreadNoteOff, n);
+			const size_t n = extra.size();
+			extra.clear();
+			return n;
+		});
+}
+
+// A fresh engine filling its note pool from empty up to default_note_capacity
+static void profile_pool_growth(void)
+{
+	std::vector<held_note> notes;
+	for (uint32_t i = 0; i < default_note_capacity; ++i)
+		notes.push_back(random_note());
+
+	SpreadEngine* engine = nullptr;
+	measure("pool_growth", "note_on",
+		[&] { delete engine; engine = new SpreadEngine(); configure(*engine, kRoundRobin, 16); },
+		[&] {
+			for (const held_note& n : notes)
+				send(*engine, kSpreadNoteOn, n);
+			return notes.size();
+		});
+	delete engine;
+}
+
+static bool compare(const char* path, double tolerance)
+{
+	FILE* f = fopen(path, "r");
+	if (!f)
+	{
+		fprintf(stderr, "cannot open baseline %s\n", path);
+		return false;
+	}
+
+	bool ok = true;
+	char line[256];
+	printf("\n%-16s %-14s %10s %10s %8s\n", "# profile", "operation", "baseline", "current", "ratio");
+	while (fgets(line, sizeof(line), f))
+	{
+		char profile[64], op[64];
+		double base;
+		if ((line[0] == '#') || (sscanf(line, "%63s %63s %lf", profile, op, &base) != 3))
+			continue;
+		for (const bench_result& r : results)
+		{
+			if ((r.profile == profile) && (r.op == op))
+			{
+				const double ratio = r.ns_per_event / base;
+				const bool regressed = ratio > 1. + tolerance;
+				printf("%-16s %-14s %10.1f %10.1f %8.2f%s\n", profile, op, base, r.ns_per_event, ratio, regressed ? "  REGRESSION" : "");
+				ok = ok && !regressed;
+			}
+		}
+	}
+	fclose(f);
+	return ok;
+}
+
+int main(int argc, char** argv)
+{
+	const char* baseline = nullptr;
+	double tolerance = 0.25;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "--compare") && (i + 1 < argc))
+			baseline = argv[++i];
+		else if (!strcmp(argv[i], "--tolerance") && (i + 1 < argc))
+			tolerance = atof(argv[++i]);
+		else if (!strcmp(argv[i], "--trials") && (i + 1 < argc))
+			trials = std::max(1, atoi(argv[++i]));
+		else
+		{
+			fprintf(stderr, "usage: %s [--compare baseline.txt] [--tolerance fraction] [--trials n]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	profile_held512();
+	profile_chord_cluster();
+	profile_sustain_storm();
+	profile_minload16();
+	profile_minload128();
+	profile_held8192();
+	profile_tails16();
+	profile_pool_growth();
+
+	printf("# SpreadBench: median nanoseconds per input event (lower is better)\n");
+	printf("%-16s %-14s %10s\n", "# profile", "operation", "ns/event");
+	for (const bench_result& r : results)
+		printf("%-16s %-14s %10.1f\n", r.profile.c_str(), r.op.c_str(), r.ns_per_event);
+
+	if (baseline && !compare(baseline, tolerance))
+		return 1;
+	return 0;
+}
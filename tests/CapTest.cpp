@@ -0,0 +1,151 @@
+// Per-channel polyphony caps: every strategy keeps to them, the overflow policies act once all targets are full, and
+// notes held by the sustain and sostenuto pedals count against a cap until the pedal lets them go.
+
+#include <initializer_list>
+
+#include "SpreadTest.h"
+
+static void configure_caps(SpreadEngine& engine, int16_t channels, int32_t strategy, int32_t overflow, uint8_t cap)
+{
+	configure(engine, channels, strategy);
+	engine.set_overflow(overflow);
+	for (int16_t c = 0; c < channels; ++c)
+		engine.set_polyphony_cap(c, cap);
+}
+
+static void test_caps_hold(void)
+{
+	for (int32_t strategy = 0; strategy < kNumStrategies; ++strategy)
+	{
+		for (int16_t channels : { 3, 4, 16 })
+		{
+			SpreadEngine engine;
+			configure_caps(engine, channels, strategy, kOverflowDrop, 2);
+			uint32_t held[max_out_targets] = {};
+			for (int16_t i = 0; i < 2 * channels; ++i)
+			{
+				const int16_t target = note_on(engine, (int16_t)(40 + i));
+				CHECK(target >= 0);
+				if (target >= 0)
+					++held[target];
+			}
+			for (int16_t t = 0; t < max_out_targets; ++t)
+				CHECK(held[t] <= 2);
+			CHECK(engine.get_held_count() == (uint32_t)(2 * channels));
+		}
+	}
+}
+
+static void test_overflow(void)
+{
+	for (int32_t overflow = 0; overflow < kNumOverflows; ++overflow)
+	{
+		SpreadEngine engine;
+		configure_caps(engine, 4, kMinLoad, overflow, 1);
+		for (int16_t i = 0; i < 4; ++i)
+			note_on(engine, (int16_t)(60 + i));
+
+		const int16_t target = note_on(engine, 70);
+		switch (overflow)
+		{
+		case kOverflowSteal:
+			// the oldest note on the chosen target is released first, and the new one takes its place
+			CHECK(emitted(kSpreadNoteOff) == 1);
+			CHECK(emitted(kSpreadNoteOn) == 1);
+			CHECK(target_of(out.events[0]) == target);
+			CHECK(engine.get_held_count() == 4);
+			break;
+		case kOverflowExceed:
+			CHECK(emitted(kSpreadNoteOn) == 1);
+			CHECK(engine.get_held_count() == 5);
+			break;
+		case kOverflowDrop:
+			CHECK(out.count == 0);
+			CHECK(engine.get_held_count() == 4);
+			CHECK(note_off(engine, 70) == -1);	// the dropped note's note-off goes nowhere
+			break;
+		}
+
+		// a released voice is taken by the next note
+		const int16_t freed = note_off(engine, 61);
+		if ((freed >= 0) && (overflow != kOverflowExceed))
+			CHECK(note_on(engine, 71) == freed);
+	}
+}
+
+static void test_sustain_counts(void)
+{
+	SpreadEngine engine;
+	configure_caps(engine, 2, kRoundRobin, kOverflowDrop, 1);
+	engine.press_sustain_pedal(nullptr, 0);
+	note_on(engine, 60);
+	note_on(engine, 61);
+	note_off(engine, 60);
+	note_off(engine, 61);
+	CHECK(note_on(engine, 62) == -1);	// both voices are still ringing under the pedal
+	engine.release_sustain_pedal(nullptr, 0);
+	CHECK(note_on(engine, 62) >= 0);
+
+	for (int16_t c = 0; c < 2; ++c)
+		engine.set_polyphony_cap(c, 0);
+	for (int16_t i = 0; i < 10; ++i)
+		CHECK(note_on(engine, (int16_t)(70 + i)) >= 0);
+}
+
+static void test_sostenuto_releases(void)
+{
+	// notes latched by the sostenuto pedal must free their voices when it comes up, however often it is used
+	SpreadEngine engine;
+	configure_caps(engine, 2, kMinLoad, kOverflowDrop, 2);
+	for (int cycle = 0; cycle < 5; ++cycle)
+	{
+		note_on(engine, 60);
+		note_on(engine, 61);
+		engine.press_sostenuto_pedal(nullptr, 0);
+		note_off(engine, 60);
+		note_off(engine, 61);
+		engine.release_sostenuto_pedal(nullptr, 0);
+	}
+	CHECK(engine.get_susload(0) == 0);
+	CHECK(engine.get_susload(1) == 0);
+	CHECK(note_on(engine, 70) >= 0);
+}
+
+static void test_pedals_together(void)
+{
+	SpreadEngine engine;
+	engine.set_outchannels(nullptr, 1, 0);
+
+	// sustain up first: the sostenuto pedal keeps only the note it latched
+	note_on(engine, 60);
+	engine.press_sostenuto_pedal(nullptr, 0);
+	engine.press_sustain_pedal(nullptr, 0);
+	note_off(engine, 60);
+	note_on(engine, 62);
+	note_off(engine, 62);
+	CHECK(engine.get_susload(0) == 2);
+	engine.release_sustain_pedal(nullptr, 0);
+	CHECK(engine.get_susload(0) == 1);
+	engine.release_sostenuto_pedal(nullptr, 0);
+	CHECK(engine.get_susload(0) == 0);
+
+	// sostenuto up first: the sustain pedal goes on holding the note
+	note_on(engine, 60);
+	engine.press_sostenuto_pedal(nullptr, 0);
+	engine.press_sustain_pedal(nullptr, 0);
+	note_off(engine, 60);
+	engine.release_sostenuto_pedal(nullptr, 0);
+	CHECK(engine.get_susload(0) == 1);
+	engine.release_sustain_pedal(nullptr, 0);
+	CHECK(engine.get_susload(0) == 0);
+}
+
+int main(void)
+{
+	test_caps_hold();
+	test_overflow();
+	test_sustain_counts();
+	test_sostenuto_releases();
+	test_pedals_together();
+	return report("CapTest");
+}
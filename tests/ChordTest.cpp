@@ -0,0 +1,71 @@
+// Chord placement: under the weighted load model, a load-aware strategy places a chord's notes heaviest first
+// (longest processing time first), which keeps one heavy note from landing on a target the light ones already loaded.
+
+#include "SpreadTest.h"
+
+// A chord struck lightest first: notes costing 1, 2, 2 and 6 under the default cost table.
+static const int16_t chord_pitch[4] = { 100, 70, 72, 30 };
+static const float chord_velocity[4] = { 0.1F, 0.1F, 0.1F, 1.F };
+
+static void strike(SpreadEngine& engine)
+{
+	spread_event chord[4] = {};
+	for (int32_t i = 0; i < 4; ++i)
+	{
+		chord[i].type = kSpreadNoteOn;
+		chord[i].pitch = chord_pitch[i];
+		chord[i].velocity = chord_velocity[i];
+		chord[i].noteId = no_note_id;
+	}
+	out.count = 0;
+	CHECK(engine.chord_on(&out, chord, 4));
+	CHECK(emitted(kSpreadNoteOn) == 4);
+}
+
+// Pitch of the nth note-on emitted by the last strike
+static int16_t placed(uint32_t n)
+{
+	for (uint32_t i = 0; i < out.count; ++i)
+	{
+		if ((out.events[i].type == kSpreadNoteOn) && (n-- == 0))
+			return out.events[i].pitch;
+	}
+	return -1;
+}
+
+static void test_heaviest_first(void)
+{
+	SpreadEngine engine;
+	configure(engine, 2, kMinLoad);
+	engine.set_load_model(kLoadWeighted);
+	strike(engine);
+	CHECK(placed(0) == 30);
+	CHECK(placed(1) == 70);	// equal costs keep their order
+	CHECK(placed(2) == 72);
+	CHECK(placed(3) == 100);
+
+	// 6 against 2 + 2 + 1, where arrival order would have given 1 + 2 against 2 + 6
+	const uint32_t a = engine.get_load(0), b = engine.get_load(1);
+	CHECK(((a == 6) && (b == 5)) || ((a == 5) && (b == 6)));
+}
+
+static void test_arrival_order(void)
+{
+	// counting notes, or a strategy that ignores load, leaves the chord as it came
+	for (int32_t model = 0; model < kNumLoadModels; ++model)
+	{
+		SpreadEngine engine;
+		configure(engine, 2, (model == kLoadWeighted) ? kRoundRobin : kMinLoad);
+		engine.set_load_model(model);
+		strike(engine);
+		for (uint32_t i = 0; i < 4; ++i)
+			CHECK(placed(i) == chord_pitch[i]);
+	}
+}
+
+int main(void)
+{
+	test_heaviest_first();
+	test_arrival_order();
+	return report("ChordTest");
+}
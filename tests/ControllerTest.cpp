@@ -0,0 +1,102 @@
+// Controller passthrough: sounding targets get each change at once, idle ones get what they missed just before their
+// next note, taken from the input channel that note arrived on, and MPE member notes bring their own per-note values.
+
+#include "SpreadTest.h"
+
+static void message(SpreadEngine& engine, int16_t in_channel, int32_t m, uint16_t value)
+{
+	out.count = 0;
+	engine.channel_message(&out, in_channel, m, value, 0, 0.);
+}
+
+// Value of message m sent to the target since the last send, or -1 if it was sent none
+static int32_t sent(int32_t m, int16_t target)
+{
+	int32_t value = -1;
+	for (uint32_t i = 0; i < out.count; ++i)
+	{
+		const spread_event& e = out.events[i];
+		if ((e.type == kSpreadControlChange) && (e.controlNumber == channel_message_cc[m]) && (target_of(e) == target))
+			value = (int32_t)(uint8_t)e.value | ((int32_t)(uint8_t)e.value2 << 7);
+	}
+	return value;
+}
+
+static void test_replay_before_first_note(void)
+{
+	SpreadEngine engine;
+	configure(engine, 2, kRoundRobin);
+	message(engine, 0, kMessageVolume, 90);
+	CHECK(out.count == 0);	// nothing is sounding, so nothing is woken
+
+	const int16_t first = note_on(engine, 60);
+	CHECK(sent(kMessageVolume, first) == 90);
+	CHECK(out.events[out.count - 1].type == kSpreadNoteOn);	// the controller comes first
+	CHECK(emitted(kSpreadControlChange) == 1);	// and only what differs from the defaults
+
+	// the sounding target gets a change at once, the idle one just before its note
+	message(engine, 0, kMessageVolume, 80);
+	CHECK(sent(kMessageVolume, first) == 80);
+	CHECK(out.count == 1);
+	const int16_t second = note_on(engine, 62);
+	CHECK(second != first);
+	CHECK(sent(kMessageVolume, second) == 80);
+
+	// once up to date, a target is not sent the value again
+	note_off(engine, 60);
+	note_off(engine, 62);
+	CHECK(note_on(engine, 64) == first);
+	CHECK(emitted(kSpreadControlChange) == 0);
+}
+
+static void test_input_channels(void)
+{
+	// CC 7 on two input channels: each note's target gets the value from the note's own channel
+	SpreadEngine engine;
+	configure(engine, 2, kRoundRobin);
+	message(engine, 0, kMessageVolume, 110);
+	message(engine, 1, kMessageVolume, 50);
+
+	const int16_t a = send(engine, kSpreadNoteOn, 60, no_note_id, 0.5F, 1);
+	CHECK(sent(kMessageVolume, a) == 50);
+	const int16_t b = send(engine, kSpreadNoteOn, 62, no_note_id, 0.5F, 0);
+	CHECK(sent(kMessageVolume, b) == 110);
+	send(engine, kSpreadNoteOff, 60, no_note_id, 0.5F, 1);
+	send(engine, kSpreadNoteOff, 62, no_note_id, 0.5F, 0);
+
+	// round robin swaps them, so each target now needs the other channel's value
+	CHECK(send(engine, kSpreadNoteOn, 64, no_note_id, 0.5F, 0) == a);
+	CHECK(sent(kMessageVolume, a) == 110);
+	CHECK(send(engine, kSpreadNoteOn, 65, no_note_id, 0.5F, 1) == b);
+	CHECK(sent(kMessageVolume, b) == 50);
+}
+
+static void test_mpe_member(void)
+{
+	// a member note takes its per-note messages from its own channel and the rest from the zone's master channel
+	SpreadEngine engine;
+	configure(engine, 4, kRoundRobin);
+	engine.set_mpe_zones(3, 0);
+	message(engine, 0, kMessagePitchBend, 1000);
+	message(engine, 0, kMessageVolume, 70);
+	message(engine, 2, kMessagePitchBend, 9000);
+	CHECK(out.count == 0);
+
+	const int16_t target = send(engine, kSpreadNoteOn, 60, no_note_id, 0.5F, 2);
+	CHECK(sent(kMessagePitchBend, target) == 9000);
+	CHECK(sent(kMessageVolume, target) == 70);
+	CHECK(emitted(kSpreadControlChange) == 2);
+
+	// and the member channel's later messages follow the note
+	message(engine, 2, kMessagePressure, 40);
+	CHECK(sent(kMessagePressure, target) == 40);
+	CHECK(out.count == 1);
+}
+
+int main(void)
+{
+	test_replay_before_first_note();
+	test_input_channels();
+	test_mpe_member();
+	return report("ControllerTest");
+}
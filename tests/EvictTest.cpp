@@ -0,0 +1,101 @@
+// Eviction policies: with the note pool full, each policy releases the note it promises to make room for a new one.
+
+#include "SpreadTest.h"
+
+constexpr int32_t pool_notes = (int32_t)min_note_capacity;
+
+// Tests fill the pool with noteIds 0 to pool_notes - 1, struck in that order, then overflow it.
+static void configure_pool(SpreadEngine& engine, int32_t policy, int16_t channels, int32_t strategy)
+{
+	engine.set_capacity(min_note_capacity);
+	engine.allocate_pool();
+	configure(engine, channels, strategy);
+	engine.set_eviction(policy);
+}
+
+// noteId of the note the last send released to make room, or -1 if it released none
+static int32_t evicted(void)
+{
+	for (uint32_t i = 0; i < out.count; ++i)
+	{
+		if (out.events[i].type == kSpreadNoteOff)
+			return out.events[i].noteId;
+	}
+	return -1;
+}
+
+static void test_oldest(void)
+{
+	SpreadEngine engine;
+	configure_pool(engine, kEvictOldest, 4, kMinLoad);
+	for (int32_t id = 0; id < pool_notes; ++id)
+		note_on(engine, (int16_t)id, id);
+	note_on(engine, 0, 1000);
+	CHECK(evicted() == 0);
+	note_on(engine, 1, 1001);
+	CHECK(evicted() == 1);
+	CHECK(engine.get_held_count() == (uint32_t)pool_notes);
+	CHECK(engine.get_eviction_count() == 2);
+}
+
+static void test_quietest(void)
+{
+	SpreadEngine engine;
+	configure_pool(engine, kEvictQuietest, 4, kMinLoad);
+	for (int32_t id = 0; id < pool_notes; ++id)
+		note_on(engine, (int16_t)id, id, ((id == 40) || (id == 90)) ? 0.2F : 0.8F);
+	note_on(engine, 0, 1000, 0.8F);
+	CHECK(evicted() == 40);
+	note_on(engine, 1, 1001, 0.8F);
+	CHECK(evicted() == 90);
+	note_on(engine, 2, 1002, 0.8F);
+	CHECK(evicted() == 0);	// among equals, the oldest
+}
+
+static void test_busiest(void)
+{
+	// Round Robin over two channels alternates targets; releasing the newest notes from one leaves the other the
+	// busiest while the first still holds the oldest note
+	SpreadEngine engine;
+	configure_pool(engine, kEvictBusiest, 2, kRoundRobin);
+	int16_t target[pool_notes];
+	for (int32_t id = 0; id < pool_notes; ++id)
+		target[id] = note_on(engine, (int16_t)id, id);
+	const int16_t busy = target[1];
+	CHECK(busy != target[0]);
+	int32_t released = 0;
+	for (int32_t id = pool_notes - 1; (id >= 0) && (released < 8); --id)
+	{
+		if (target[id] != busy)
+		{
+			note_off(engine, (int16_t)id, id);
+			++released;
+		}
+	}
+	for (int32_t id = pool_notes; id < pool_notes + released; ++id)
+		note_on(engine, (int16_t)(id % 128), id);
+
+	note_on(engine, 127, 1000);
+	CHECK(evicted() == 1);	// the oldest note on the busiest target, not the oldest overall
+}
+
+static void test_stacked(void)
+{
+	SpreadEngine engine;
+	configure_pool(engine, kEvictStacked, 4, kMinLoad);
+	for (int32_t id = 0; id < pool_notes; ++id)
+		note_on(engine, (int16_t)((id == 100) ? 50 : id), id);	// note 50's pitch is struck again by note 100
+	note_on(engine, 100, 1000);
+	CHECK(evicted() == 50);
+	note_on(engine, 101, 1001);
+	CHECK(evicted() == 0);	// nothing is stacked any more, so the oldest
+}
+
+int main(void)
+{
+	test_oldest();
+	test_quietest();
+	test_busiest();
+	test_stacked();
+	return report("EvictTest");
+}
@@ -0,0 +1,80 @@
+// Diagnostic log: nothing is written at the default level, raising the level at run time starts the writer, records
+// above the level are skipped, the arguments are formatted by the writer thread, and stopping drains the ring.
+
+#define LOGGING
+
+#include <cstdlib>
+#include <string>
+
+#include "SpreadLog.h"
+#include "SpreadTest.h"
+
+static std::string contents(const char* path)
+{
+	std::string text;
+	if (FILE* f = fopen(path, "rb"))
+	{
+		char buffer[4096];
+		size_t n;
+		while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+			text.append(buffer, n);
+		fclose(f);
+	}
+	return text;
+}
+
+static bool contains(const std::string& text, const char* line)
+{
+	return text.find(line) != std::string::npos;
+}
+
+int main(int argc, char** argv)
+{
+	// the log file is given by the test driver, so the test leaves nothing outside the build tree
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: LogTest <log file>\n");
+		return 2;
+	}
+	const char* path = argv[1];
+	remove(path);
+#ifdef _WIN32
+	_putenv_s("SPREAD_LOG_FILE", path);
+	_putenv_s("SPREAD_LOG_LEVEL", "");
+#else
+	setenv("SPREAD_LOG_FILE", path, 1);
+	unsetenv("SPREAD_LOG_LEVEL");
+#endif
+
+	// off by default: the calls are compiled in but write nothing
+	spread_log_start();
+	CHECK(log_level.load() == kLogOff);
+	LOG_ERROR("while off %d\n", 1);
+	spread_log_stop();
+	CHECK(contents(path).empty());
+
+	spread_log_set_level(kLogInfo);
+	spread_log(kLogInfo, "info %d %u %s %.2f %x %5s|%%\n", -5, 7u, "text", 1.5, 255u, "ab");
+	LOG("trace %d\n", 2);	// above the level
+	LOG_ERROR("error %lld\n", (long long)1 << 40);
+	spread_log_stop();
+	std::string text = contents(path);
+	CHECK(contains(text, "] info -5 7 text 1.50 ff    ab|%\n"));
+	CHECK(contains(text, "] error 1099511627776\n"));
+	CHECK(!contains(text, "trace"));
+	CHECK(!contains(text, "while off"));
+
+	// the level can change again after the writer has stopped, and the log is appended to
+	spread_log_set_level(kLogTrace);
+	LOG("trace %d\n", 3);
+	spread_log_set_level(kLogOff);
+	LOG_ERROR("after %d\n", 4);
+	spread_log_stop();
+	text = contents(path);
+	CHECK(contains(text, "] info -5"));
+	CHECK(contains(text, "] trace 3\n"));
+	CHECK(!contains(text, "after"));
+
+	remove(path);
+	return report("LogTest");
+}
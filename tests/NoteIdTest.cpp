@@ -0,0 +1,85 @@
+// noteId routing: note-offs and note expressions reach the target of the note they address, including when several
+// held notes share a pitch, and before and after the noteId index is built by the first expression.
+
+#include "SpreadTest.h"
+
+static int16_t expression(SpreadEngine& engine, int32_t noteId)
+{
+	spread_event e = {};
+	e.type = kSpreadNoteExpression;
+	e.noteId = noteId;
+	e.tag = 7;
+	out.count = 0;
+	engine.process_event(e, &out);
+	return (out.count == 1) ? target_of(out.events[0]) : -1;
+}
+
+static void test_expressions(void)
+{
+	SpreadEngine engine;
+	engine.set_outchannels(nullptr, 4, 0);
+	engine.set_outbuses(nullptr, 2, 0);
+	int16_t target[6];
+	for (int32_t i = 0; i < 6; ++i)
+		target[i] = note_on(engine, 60, 100 + i);	// one pitch, so only the noteId tells the notes apart
+
+	// the first expression builds the index from the notes already held
+	for (int32_t i = 0; i < 6; ++i)
+		CHECK(expression(engine, 100 + i) == target[i]);
+	CHECK(out.events[0].tag == 7);
+	CHECK(expression(engine, 200) == -1);	// not held
+	CHECK(expression(engine, no_note_id) == -1);
+
+	// once built, the index follows note-ons and note-offs
+	CHECK(note_off(engine, 60, 102) == target[2]);
+	CHECK(expression(engine, 102) == -1);
+	const int16_t late = note_on(engine, 61, 106);
+	CHECK(expression(engine, 106) == late);
+
+	// and survives the pool being reallocated
+	engine.set_capacity(1024);
+	engine.allocate_pool();
+	CHECK(expression(engine, 104) == target[4]);
+	CHECK(expression(engine, 106) == late);
+
+	engine.release_all(&out, 0, 0., kSpreadCtrlAllNotesOff);
+	CHECK(expression(engine, 100) == -1);
+	const int16_t again = note_on(engine, 62, 100);
+	CHECK(expression(engine, 100) == again);
+}
+
+static void test_shared_noteId(void)
+{
+	// two held notes with one noteId: expressions go to the older, and to the newer once the older is released
+	SpreadEngine engine;
+	configure(engine, 2, kRoundRobin);
+	const int16_t first = note_on(engine, 60, 5);
+	const int16_t second = note_on(engine, 64, 5);
+	CHECK(first != second);
+	CHECK(expression(engine, 5) == first);
+	CHECK(note_off(engine, 60, 5) == first);
+	CHECK(expression(engine, 5) == second);
+}
+
+static void test_note_off_by_noteId(void)
+{
+	// without any expressions, note-offs on a shared pitch still find their own notes
+	SpreadEngine engine;
+	configure(engine, 3, kRoundRobin);
+	int16_t target[3];
+	for (int32_t i = 0; i < 3; ++i)
+		target[i] = note_on(engine, 60, 10 + i);
+	CHECK(note_off(engine, 60, 11) == target[1]);
+	CHECK(note_off(engine, 60, 12) == target[2]);
+	CHECK(note_off(engine, 60, 10) == target[0]);
+	CHECK(note_off(engine, 60, 10) == -1);
+	CHECK(engine.get_held_count() == 0);
+}
+
+int main(void)
+{
+	test_expressions();
+	test_shared_noteId();
+	test_note_off_by_noteId();
+	return report("NoteIdTest");
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+// Minimal harness shared by the engine tests: each test program drives a SpreadEngine directly with events, checks
+// what it emits, and exits nonzero if any check failed, which is all ctest needs.
+
+#include <cstdio>
+
+#include "SpreadEngine.h"
+
+static spread_event out_storage[max_events_per_call];
+static spread_output out = { out_storage, max_events_per_call, 0 };
+static int failures = 0;
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) \
+		{ \
+			fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+			++failures; \
+		} \
+	} while (0)
+
+// Spreads over the given number of output channels on one bus with the given strategy.
+static inline void configure(SpreadEngine& engine, int16_t channels, int32_t strategy)
+{
+	engine.set_outchannels(nullptr, channels, 0);
+	engine.set_strategy(strategy);
+}
+
+static inline int16_t target_of(const spread_event& e)
+{
+	return TARGET_OF(e.bus, e.channel);
+}
+
+// Sends one event and returns the target of the last note-on or note-off it produced, or -1 if it produced none.
+// Everything the event emitted stays in out until the next call.
+static inline int16_t send(SpreadEngine& engine, uint8_t type, int16_t pitch, int32_t noteId = no_note_id,
+	float velocity = 0.5F, int16_t channel = 0)
+{
+	spread_event e = {};
+	e.type = type;
+	e.channel = channel;
+	e.pitch = pitch;
+	e.noteId = noteId;
+	e.velocity = velocity;
+	out.count = 0;
+	engine.process_event(e, &out);
+	int16_t target = -1;
+	for (uint32_t i = 0; i < out.count; ++i)
+	{
+		if ((out.events[i].type == kSpreadNoteOn) || (out.events[i].type == kSpreadNoteOff))
+			target = target_of(out.events[i]);
+	}
+	return target;
+}
+
+static inline int16_t note_on(SpreadEngine& engine, int16_t pitch, int32_t noteId = no_note_id, float velocity = 0.5F)
+{
+	return send(engine, kSpreadNoteOn, pitch, noteId, velocity);
+}
+
+static inline int16_t note_off(SpreadEngine& engine, int16_t pitch, int32_t noteId = no_note_id)
+{
+	return send(engine, kSpreadNoteOff, pitch, noteId);
+}
+
+// Number of emitted events of the given type since the last send
+static inline uint32_t emitted(uint8_t type)
+{
+	uint32_t n = 0;
+	for (uint32_t i = 0; i < out.count; ++i)
+		n += (out.events[i].type == type) ? 1 : 0;
+	return n;
+}
+
+static inline int report(const char* name)
+{
+	if (failures)
+		fprintf(stderr, "%s: %d check(s) failed\n", name, failures);
+	else
+		printf("%s: all checks passed\n", name);
+	return failures ? 1 : 0;
+}
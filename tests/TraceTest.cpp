@@ -0,0 +1,231 @@
+// Trace round trip: an engine is driven the way the processor drives it, capturing a trace that opens while notes
+// are still sounding, and replay_trace (SpreadReplay's code path) must reproduce the captured output exactly.
+
+#include <string>
+#include <vector>
+
+#include "SpreadTrace.h"
+#include "SpreadTest.h"
+
+constexpr int32_t block_samples = 512;
+
+// Captures like Spread::process: the pending snapshot first (once the engine is idle, if the trace has not begun),
+// then each input, and the block's digest at the end.  The output the trace records is also dumped, for comparing
+// with the replay's.
+struct capture {
+	SpreadEngine engine;
+	trace_writer trace;
+	bool pending = true;
+	uint32_t blocks = 0;	// recorded
+	uint32_t outputs = 0;
+	uint64_t digest = trace_digest_basis;
+	FILE* dump = nullptr;
+};
+
+static void captured(capture& c)
+{
+	c.digest = trace_digest(c.digest, out.events, out.count);
+	c.outputs += out.count;
+	if (c.trace.is_recording())
+	{
+		for (uint32_t i = 0; i < out.count; ++i)
+			dump_trace_event(c.dump, c.blocks + 1, out.events[i]);
+	}
+	out.count = 0;
+}
+
+static void begin_block(capture& c)
+{
+	if (c.pending && (c.trace.is_recording() || c.engine.is_idle()))
+	{
+		const trace_snapshot s = take_trace_snapshot(c.engine, true);
+		c.trace.write(kTraceSnapshot, &s, sizeof(s));
+		c.pending = false;
+	}
+}
+
+static void event(capture& c, uint8_t type, int16_t pitch, int16_t channel = 0, float velocity = 0.5F, int32_t offset = 0)
+{
+	spread_event e = {};
+	e.type = type;
+	e.channel = channel;
+	e.pitch = pitch;
+	e.velocity = velocity;
+	e.noteId = no_note_id;
+	e.sampleOffset = offset;
+	const trace_event t = to_trace_event(e);
+	c.trace.write(kTraceEvent, &t, sizeof(t));
+	c.engine.process_event(e, &out);
+	captured(c);
+}
+
+static void chord(capture& c, const int16_t* pitches, uint16_t n, int32_t offset)
+{
+	spread_event notes[max_chord_notes] = {};
+	unsigned char record[sizeof(uint16_t) + max_chord_notes * sizeof(trace_event)];
+	memcpy(record, &n, sizeof(n));
+	for (uint16_t i = 0; i < n; ++i)
+	{
+		notes[i].type = kSpreadNoteOn;
+		notes[i].pitch = pitches[i];
+		notes[i].velocity = 0.25F * (float)(i + 1);
+		notes[i].noteId = no_note_id;
+		notes[i].sampleOffset = offset;
+		const trace_event t = to_trace_event(notes[i]);
+		memcpy(record + sizeof(n) + i * sizeof(t), &t, sizeof(t));
+	}
+	c.trace.write(kTraceChord, record, (uint16_t)(sizeof(n) + n * sizeof(trace_event)));
+	c.engine.chord_on(&out, notes, n);
+	captured(c);
+}
+
+static void parameter(capture& c, uint32_t id, double value, int32_t offset = 0)
+{
+	const trace_parameter p = { id, offset, value, 0. };
+	c.trace.write(kTraceParameter, &p, sizeof(p));
+	c.engine.set_parameter(id, value, offset, 0., &out);
+	captured(c);
+}
+
+static void end_block(capture& c)
+{
+	const trace_block b = { block_samples, c.outputs, c.digest };
+	c.trace.write(kTraceBlock, &b, sizeof(b));
+	if (c.trace.is_recording())
+		++c.blocks;
+	c.outputs = 0;
+	c.digest = trace_digest_basis;
+	c.engine.advance_clock(block_samples);
+}
+
+static uint32_t volume(int16_t channel)
+{
+	return kChannelMessage + kMessageVolume * 16 + (uint32_t)channel;
+}
+
+static std::vector<unsigned char> contents(const std::string& path)
+{
+	std::vector<unsigned char> data;
+	if (FILE* f = fopen(path.c_str(), "rb"))
+	{
+		unsigned char buffer[4096];
+		size_t n;
+		while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+			data.insert(data.end(), buffer, buffer + n);
+		fclose(f);
+	}
+	return data;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		fprintf(stderr, "usage: TraceTest <directory>\n");
+		return 2;
+	}
+	const std::string trace_path = std::string(argv[1]) + "/TraceTest.sptrace";
+	const std::string live_path = std::string(argv[1]) + "/TraceTest.live";
+	const std::string replay_path = std::string(argv[1]) + "/TraceTest.replay";
+
+	capture* c = new capture();
+	c->dump = fopen(live_path.c_str(), "w");
+	CHECK(c->dump != nullptr);
+	if (!c->dump)
+		return report("TraceTest");
+	c->engine.set_sample_rate(48000.);
+	c->engine.set_release_ms(100);
+	c->engine.set_load_model(kLoadWeighted);
+	c->engine.set_strategy(kRoundRobin);
+	CHECK(c->engine.allocate_pool());
+
+	// what the processor keeps across a deactivation: held and sustained notes, and the controllers each target was
+	// already sent (round robin puts channel 1's note on the first target, and channel 0's on the others)
+	parameter(*c, volume(0), 0.25);
+	parameter(*c, volume(1), 0.5);
+	event(*c, kSpreadNoteOn, 60, 1);
+	for (int16_t i = 0; i < 3; ++i)
+		event(*c, kSpreadNoteOn, (int16_t)(40 + i));
+	parameter(*c, kSustain, 1.);
+	for (int16_t i = 0; i < 3; ++i)
+		event(*c, kSpreadNoteOff, (int16_t)(40 + i));
+	CHECK(c->trace.open(trace_path.c_str()));
+
+	const int16_t triad[3] = { 48, 52, 55 };
+	const int32_t total_blocks = 40;
+	for (int32_t block = 0; block < total_blocks; ++block)
+	{
+		begin_block(*c);
+		switch (block)
+		{
+		case 1:
+			event(*c, kSpreadNoteOff, 60, 1, 0.5F, 100);
+			break;
+		case 2:
+			parameter(*c, kSustain, 0., 7);	// the sustained note starts its tail, about 10 blocks long
+			break;
+		case 20:
+			parameter(*c, volume(1), 0.75, 3);
+			event(*c, kSpreadNoteOn, 30, 0, 1.F, 10);	// on the first target, which was last sent channel 1's volume
+			event(*c, kSpreadNoteOn, 70, 1, 0.9F, 10);
+			break;
+		case 21:
+			parameter(*c, kStrategy, 0., 0);	// Min-Load, which places the chord heaviest first
+			chord(*c, triad, 3, 0);
+			parameter(*c, volume(0), 0.5, 64);	// sent live to the sounding targets
+			break;
+		case 22:
+			event(*c, kSpreadNoteOff, 70, 1);
+			event(*c, kSpreadNoteOn, 72, 0, 0.3F, 200);
+			break;
+		case 23:
+			parameter(*c, kSustain, 1.);
+			for (int16_t i = 0; i < 3; ++i)
+				event(*c, kSpreadNoteOff, triad[i], 0, 0.5F, 16 * i);
+			break;
+		case 24:
+			event(*c, kSpreadNoteOn, 74, 1);
+			parameter(*c, kSustain, 0., 300);
+			break;
+		case 26:
+			event(*c, kSpreadNoteOff, 30);
+			event(*c, kSpreadNoteOff, 72);
+			event(*c, kSpreadNoteOff, 74, 1);
+			break;
+		}
+		end_block(*c);
+	}
+	c->trace.close();
+	fclose(c->dump);
+
+	// the trace waited for the notes from before it, so it began part way through, with nothing sounding
+	CHECK(c->blocks <= (uint32_t)total_blocks - 12);	// the last tail ends about 12 blocks in
+	CHECK(c->blocks >= (uint32_t)total_blocks - 20);
+
+	const std::vector<unsigned char> trace = contents(trace_path);
+	CHECK(is_trace(trace.data(), trace.size()));
+	FILE* dump = fopen(replay_path.c_str(), "w");
+	CHECK(dump != nullptr);
+	if (dump)
+	{
+		replay_stats stats = {};
+		CHECK(replay_trace(trace.data(), trace.size(), dump, stats));
+		fclose(dump);
+		CHECK(!stats.malformed);
+		CHECK(stats.mismatched_block == 0);
+		CHECK(stats.blocks == c->blocks);
+		CHECK(stats.verified_blocks == c->blocks);
+		CHECK(stats.outputs > 0);
+	}
+
+	// and its output, event for event
+	const std::vector<unsigned char> live = contents(live_path);
+	CHECK(!live.empty());
+	CHECK(live == contents(replay_path));
+
+	delete c;
+	remove(trace_path.c_str());
+	remove(live_path.c_str());
+	remove(replay_path.c_str());
+	return report("TraceTest");
+}
@@ -0,0 +1,79 @@
+// Zoned strategy: each output channel gets only the notes in its key and velocity zones until the owners reach the
+// spill load, and then the notes spill into the neighbouring channels' zones, one channel further out at a time.
+
+#include "SpreadTest.h"
+
+// Splits the keyboard into four zones of 32 keys, one per output channel.
+static void configure_zones(SpreadEngine& engine, int32_t spill)
+{
+	configure(engine, 4, kZoned);
+	for (int16_t c = 0; c < 4; ++c)
+		engine.set_zone(c, { (uint8_t)(32 * c), (uint8_t)(32 * c + 31), 0, 127 });
+	engine.set_zone_spill(spill);
+}
+
+static void test_spill_at_threshold(void)
+{
+	SpreadEngine engine;
+	configure_zones(engine, 3);
+
+	// below the spill load, the zone's own channel takes every note
+	for (int16_t i = 0; i < 3; ++i)
+		CHECK(note_on(engine, (int16_t)(40 + i)) == 1);
+
+	// at it, the next notes go to the neighbours, and back to the owner once they are as loaded
+	const int16_t spilled = note_on(engine, 43);
+	CHECK((spilled == 0) || (spilled == 2));
+	const int16_t other = note_on(engine, 44);
+	CHECK((other == 0) || (other == 2));
+	CHECK(other != spilled);
+	CHECK(note_on(engine, 45) != 3);	// not a neighbour
+
+	// a released note brings the owner back under the spill load
+	note_off(engine, 40);
+	CHECK(engine.get_load(1) < 3);
+	CHECK(note_on(engine, 46) == 1);
+}
+
+static void test_spill_from_edge(void)
+{
+	// the lowest zone has one neighbour, and spills further out only once that is loaded as well
+	SpreadEngine engine;
+	configure_zones(engine, 2);
+	CHECK(note_on(engine, 10) == 0);
+	CHECK(note_on(engine, 11) == 0);
+	CHECK(note_on(engine, 12) == 1);
+	CHECK(note_on(engine, 13) == 1);
+	CHECK(note_on(engine, 14) == 2);
+}
+
+static void test_no_spill(void)
+{
+	SpreadEngine engine;
+	configure_zones(engine, 0);
+	for (int16_t i = 0; i < 20; ++i)
+		CHECK(note_on(engine, (int16_t)(100 + i)) == 3);
+}
+
+static void test_velocity_zones(void)
+{
+	// two channels split by velocity over the whole keyboard, and a key range no zone owns
+	SpreadEngine engine;
+	configure(engine, 2, kZoned);
+	engine.set_zone(0, { 0, 100, 0, 63 });
+	engine.set_zone(1, { 0, 100, 64, 127 });
+	CHECK(note_on(engine, 60, no_note_id, 0.2F) == 0);
+	CHECK(note_on(engine, 61, no_note_id, 0.9F) == 1);
+	CHECK(note_on(engine, 62, no_note_id, 0.3F) == 0);
+	const int16_t anywhere = note_on(engine, 110, no_note_id, 0.2F);
+	CHECK(anywhere == 1);	// the less loaded, as neither zone owns the key
+}
+
+int main(void)
+{
+	test_spill_at_threshold();
+	test_spill_from_edge();
+	test_no_spill();
+	test_velocity_zones();
+	return report("ZoneTest");
+}
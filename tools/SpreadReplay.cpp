@@ -0,0 +1,105 @@
+// Replays a trace captured by the plug-in (see Spread/SpreadTrace.h) through SpreadEngine with replay_trace, checking
+// every block's output against the digest recorded with it.  The trace is memory-mapped, so replays of long sessions
+// start at once.
+//
+//     SpreadReplay trace.sptrace              replay and verify; fails at the first block whose output differs
+//     SpreadReplay --dump trace.sptrace       also print every output event, one per line, for diffing
+//     SpreadReplay --repeat 20 trace.sptrace  replay 20 times and report the median routing time (for profiling)
+//
+// Capture is turned on by setting SPREAD_TRACE_DIR to a directory before the host starts; each activation of each
+// plug-in instance writes a new trace there.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "SpreadEngine.h"
+#include "SpreadTrace.h"
+
+int main(int argc, char** argv)
+{
+	const char* path = nullptr;
+	bool dump = false;
+	int repeat = 1;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "--dump"))
+			dump = true;
+		else if (!strcmp(argv[i], "--repeat") && (i + 1 < argc))
+			repeat = std::max(1, atoi(argv[++i]));
+		else if ((argv[i][0] != '-') && !path)
+			path = argv[i];
+		else
+		{
+			path = nullptr;
+			break;
+		}
+	}
+	if (!path)
+	{
+		fprintf(stderr, "usage: %s [--dump] [--repeat n] trace.sptrace\n", argv[0]);
+		return 2;
+	}
+
+	const int fd = open(path, O_RDONLY);
+	struct stat st;
+	if ((fd < 0) || (fstat(fd, &st) != 0))
+	{
+		fprintf(stderr, "%s: cannot open\n", path);
+		return 2;
+	}
+	const size_t size = (size_t)st.st_size;
+	void* mapped = (size > 0) ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+	close(fd);
+	if ((mapped == MAP_FAILED) || !is_trace((const unsigned char*)mapped, size))
+	{
+		fprintf(stderr, "%s: not a Spread trace (version %u)\n", path, (unsigned)trace_version);
+		return 2;
+	}
+	const unsigned char* data = (const unsigned char*)mapped;
+
+	std::vector<double> times;
+	replay_stats stats;
+	bool ok = true;
+	for (int i = 0; (i < repeat) && ok; ++i)
+	{
+		stats = replay_stats();
+		ok = replay_trace(data, size, (dump && (i == 0)) ? stdout : nullptr, stats);
+		times.push_back(stats.ns);
+	}
+	munmap(mapped, size);
+
+	if (stats.malformed)
+	{
+		fprintf(stderr, "%s: malformed record after block %u\n", path, stats.blocks);
+		return 2;
+	}
+	if (stats.mismatched_block)
+	{
+		fprintf(stderr, "%s: output differs from the capture in block %u\n", path, stats.mismatched_block);
+		return 1;
+	}
+	if (!ok)
+	{
+		fprintf(stderr, "%s: out of memory\n", path);
+		return 2;
+	}
+
+	std::sort(times.begin(), times.end());
+	const double median = times[times.size() / 2];
+	fprintf(stderr, "%u blocks, %u events, %u parameter points, %u outputs; %u blocks verified\n", stats.blocks,
+		stats.events, stats.parameters, stats.outputs, stats.verified_blocks);
+	if (stats.dropped)
+		fprintf(stderr, "%llu records were dropped during capture; blocks after the first gap were not verified\n",
+			(unsigned long long)stats.dropped);
+	fprintf(stderr, "routing time: %.1f us total, %.1f ns per block (median of %d)\n", median / 1000.,
+		stats.blocks ? (median / stats.blocks) : 0., repeat);
+	return 0;
+}